@@ -10,12 +10,16 @@
 #include <string_view>
 #include <vector>
 #include <deque>
-#include <unordered_set>
 #include <limits>
 #include <algorithm>
 #include <stdexcept>
 #include <optional>
 #include <bit>
+#include <type_traits>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <exception>
 
 #include "negentropy/encoding.h"
 #include "negentropy/types.h"
@@ -38,6 +42,11 @@ struct Negentropy {
 
     bool isInitiator = false;
 
+    // If greater than 1, the fingerprints (and bucket summaries of mismatched ranges) needed to
+    // respond to a message are computed up-front using this many threads. The storage must then
+    // support concurrent read access.
+    size_t reconcileThreads = 1;
+
     uint64_t lastTimestampIn = 0;
     uint64_t lastTimestampOut = 0;
 
@@ -52,7 +61,7 @@ struct Negentropy {
         std::string output;
         output.push_back(PROTOCOL_VERSION);
 
-        output += splitRange(0, storage.size(), Bound(MAX_U64));
+        splitRange(output, 0, getStorageSize(), Bound(MAX_U64));
 
         return output;
     }
@@ -64,20 +73,50 @@ struct Negentropy {
     std::string reconcile(std::string_view query) {
         if (isInitiator) throw negentropy::err("initiator not asking for have/need IDs");
 
-        std::vector<std::string> haveIds, needIds;
-        return reconcileAux(query, haveIds, needIds);
+        return reconcileAux(query, [](const Item &){}, [](std::string_view){});
     }
 
     std::optional<std::string> reconcile(std::string_view query, std::vector<std::string> &haveIds, std::vector<std::string> &needIds) {
+        return reconcile(query, [&](const Item &item){
+            haveIds.emplace_back(item.getId());
+        }, [&](std::string_view id){
+            needIds.emplace_back(id);
+        });
+    }
+
+    // Streaming version: Instead of collecting IDs into vectors, onHave is called with each of our
+    // Items that the other side lacks, and onNeed with the ID of each item we lack. The ID passed
+    // to onNeed points into query, so it must be copied if it is to be kept after onNeed returns.
+    //
+    // Timestamps of needed items are not transmitted, but if onNeed accepts two extra Bound arguments,
+    // it will be called with the [lowerBound, upperBound) range that the item was found in.
+
+    template<typename OnHave, typename OnNeed>
+    requires std::is_invocable_v<OnHave&, const Item &> && (std::is_invocable_v<OnNeed&, std::string_view> || std::is_invocable_v<OnNeed&, std::string_view, const Bound &, const Bound &>)
+    std::optional<std::string> reconcile(std::string_view query, OnHave &&onHave, OnNeed &&onNeed) {
         if (!isInitiator) throw negentropy::err("non-initiator asking for have/need IDs");
 
-        auto output = reconcileAux(query, haveIds, needIds);
+        auto output = reconcileAux(query, onHave, onNeed);
         if (output.size() == 1) return std::nullopt;
         return output;
     }
 
   private:
-    std::string reconcileAux(std::string_view query, std::vector<std::string> &haveIds, std::vector<std::string> &needIds) {
+    static const uint64_t BUCKETS = 16;
+
+    // Our side of a received Fingerprint range, computed ahead of time by precomputeRanges()
+    struct PrecomputedRange {
+        Fingerprint fingerprint;
+        std::vector<Bucket> buckets; // empty unless the range will be split into fingerprints
+    };
+
+    // Scratch space for processing received IdLists, re-used to avoid allocations
+    std::vector<std::string_view> theirIds;
+    std::vector<size_t> theirIdsByValue;
+    std::vector<bool> theirIdsMatched;
+
+    template<typename OnHave, typename OnNeed>
+    std::string reconcileAux(std::string_view query, OnHave &&onHave, OnNeed &&onNeed) {
         lastTimestampIn = lastTimestampOut = 0; // reset for each message
 
         std::string fullOutput;
@@ -90,19 +129,27 @@ struct Negentropy {
             else return fullOutput;
         }
 
-        uint64_t storageSize = storage.size();
+        uint64_t storageSize = getStorageSize();
         Bound prevBound;
         size_t prevIndex = 0;
         bool skip = false;
 
+        std::vector<std::optional<PrecomputedRange>> precomputed;
+        if (reconcileThreads > 1) precomputed = precomputeRanges(query);
+        size_t rangeIndex = 0;
+
+        // Scratch buffers, re-used for each range to avoid allocations
+        std::string o;
+        std::string responseIds;
+
         while (query.size()) {
-            std::string o;
+            o.clear();
 
             auto doSkip = [&]{
                 if (skip) {
                     skip = false;
-                    o += encodeBound(prevBound);
-                    o += encodeVarInt(uint64_t(Mode::Skip));
+                    encodeBound(o, prevBound);
+                    encodeVarInt(o, uint64_t(Mode::Skip));
                 }
             };
 
@@ -110,58 +157,88 @@ struct Negentropy {
             auto mode = Mode(decodeVarInt(query));
 
             auto lower = prevIndex;
-            auto upper = storage.findLowerBound(prevIndex, storageSize, currBound);
+            auto upper = storageFindLowerBound(prevIndex, storageSize, currBound);
 
             if (mode == Mode::Skip) {
                 skip = true;
             } else if (mode == Mode::Fingerprint) {
                 auto theirFingerprint = getBytes(query, FINGERPRINT_SIZE);
-                auto ourFingerprint = storage.fingerprint(lower, upper);
+                const PrecomputedRange *pre = rangeIndex < precomputed.size() && precomputed[rangeIndex] ? &*precomputed[rangeIndex] : nullptr;
+                auto ourFingerprint = pre ? pre->fingerprint : storageFingerprint(lower, upper);
 
                 if (theirFingerprint != ourFingerprint.sv()) {
                     doSkip();
-                    o += splitRange(lower, upper, currBound);
+                    splitRange(o, lower, upper, currBound, pre ? &pre->buckets : nullptr);
                 } else {
                     skip = true;
                 }
             } else if (mode == Mode::IdList) {
                 auto numIds = decodeVarInt(query);
 
-                std::unordered_set<std::string> theirElems;
+                theirIds.clear();
                 for (uint64_t i = 0; i < numIds; i++) {
                     auto e = getBytes(query, ID_SIZE);
-                    if (isInitiator) theirElems.insert(e);
+                    if (isInitiator) theirIds.push_back(e);
                 }
 
                 if (isInitiator) {
                     skip = true;
 
-                    storage.iterate(lower, upper, [&](const Item &item, size_t){
-                        auto k = std::string(item.getId());
+                    // IdLists don't include timestamps, so their IDs can't be merged directly against our
+                    // (timestamp, id) ordered items. Instead, each of our IDs is looked up in a sorted index
+                    // of theirs. With n of our items and m of their IDs this costs O((n + m) log m) rather
+                    // than the O(n + m) of a merge-join. Haves are output in our storage order, and needs in
+                    // the order received.
+
+                    theirIdsByValue.resize(theirIds.size());
+                    for (size_t i = 0; i < theirIds.size(); i++) theirIdsByValue[i] = i;
+                    std::sort(theirIdsByValue.begin(), theirIdsByValue.end(), [&](size_t a, size_t b){
+                        return theirIds[a] != theirIds[b] ? theirIds[a] < theirIds[b] : a < b;
+                    });
+
+                    theirIdsMatched.assign(theirIds.size(), false);
+
+                    for (size_t i = 1; i < theirIdsByValue.size(); i++) {
+                        // Only report the first copy of any duplicated IDs
+                        if (theirIds[theirIdsByValue[i]] == theirIds[theirIdsByValue[i - 1]]) theirIdsMatched[theirIdsByValue[i]] = true;
+                    }
+
+                    iterateStorage(lower, upper, [&](const Item &item, size_t){
+                        auto k = item.getId();
+
+                        auto it = std::lower_bound(theirIdsByValue.begin(), theirIdsByValue.end(), k, [&](size_t a, std::string_view target){
+                            return theirIds[a] < target;
+                        });
 
-                        if (theirElems.find(k) == theirElems.end()) {
+                        if (it == theirIdsByValue.end() || theirIds[*it] != k) {
                             // ID exists on our side, but not their side
-                            haveIds.emplace_back(k);
+                            onHave(item);
                         } else {
                             // ID exists on both sides
-                            theirElems.erase(k);
+                            theirIdsMatched[*it] = true;
                         }
 
                         return true;
                     });
 
-                    for (const auto &k : theirElems) {
+                    for (size_t i = 0; i < theirIds.size(); i++) {
                         // ID exists on their side, but not our side
-                        needIds.emplace_back(k);
+                        if (theirIdsMatched[i]) continue;
+
+                        if constexpr (std::is_invocable_v<OnNeed&, std::string_view, const Bound &, const Bound &>) {
+                            onNeed(theirIds[i], prevBound, currBound);
+                        } else {
+                            onNeed(theirIds[i]);
+                        }
                     }
                 } else {
                     doSkip();
 
-                    std::string responseIds;
+                    responseIds.clear();
                     uint64_t numResponseIds = 0;
                     Bound endBound = currBound;
 
-                    storage.iterate(lower, upper, [&](const Item &item, size_t index){
+                    iterateStorage(lower, upper, [&](const Item &item, size_t index){
                         if (exceededFrameSizeLimit(fullOutput.size() + responseIds.size())) {
                             endBound = Bound(item);
                             upper = index; // shrink upper so that remaining range gets correct fingerprint
@@ -173,9 +250,9 @@ struct Negentropy {
                         return true;
                     });
 
-                    o += encodeBound(endBound);
-                    o += encodeVarInt(uint64_t(Mode::IdList));
-                    o += encodeVarInt(numResponseIds);
+                    encodeBound(o, endBound);
+                    encodeVarInt(o, uint64_t(Mode::IdList));
+                    encodeVarInt(o, numResponseIds);
                     o += responseIds;
 
                     fullOutput += o;
@@ -187,10 +264,10 @@ struct Negentropy {
 
             if (exceededFrameSizeLimit(fullOutput.size() + o.size())) {
                 // frameSizeLimit exceeded: Stop range processing and return a fingerprint for the remaining range
-                auto remainingFingerprint = storage.fingerprint(upper, storageSize);
+                auto remainingFingerprint = storageFingerprint(upper, storageSize);
 
-                fullOutput += encodeBound(Bound(MAX_U64));
-                fullOutput += encodeVarInt(uint64_t(Mode::Fingerprint));
+                encodeBound(fullOutput, Bound(MAX_U64));
+                encodeVarInt(fullOutput, uint64_t(Mode::Fingerprint));
                 fullOutput += remainingFingerprint.sv();
                 break;
             } else {
@@ -199,59 +276,158 @@ struct Negentropy {
 
             prevIndex = upper;
             prevBound = currBound;
+            rangeIndex++;
         }
 
         return fullOutput;
     }
 
-    std::string splitRange(size_t lower, size_t upper, const Bound &upperBound) {
-        std::string o;
+    // Parses query (without producing any output) to find its Fingerprint ranges, and then computes our
+    // fingerprints for them in parallel, along with the bucket summaries of any that will be split.
+    // The results are indexed by range position. Output is still built sequentially by reconcileAux(),
+    // so timestamp delta encoding and frameSizeLimit behave exactly as in single-threaded mode.
+
+    std::vector<std::optional<PrecomputedRange>> precomputeRanges(std::string_view query) {
+        struct Job {
+            size_t rangeIndex;
+            size_t lower;
+            size_t upper;
+            std::string_view theirFingerprint;
+        };
+
+        std::vector<Job> jobs;
+        auto origTimestampIn = lastTimestampIn;
+        uint64_t storageSize = getStorageSize();
+        size_t prevIndex = 0;
+        size_t numRanges = 0;
+
+        while (query.size()) {
+            auto currBound = decodeBound(query);
+            auto mode = Mode(decodeVarInt(query));
+            auto upper = storageFindLowerBound(prevIndex, storageSize, currBound);
+
+            if (mode == Mode::Fingerprint) {
+                jobs.push_back({ numRanges, prevIndex, upper, getBytes(query, FINGERPRINT_SIZE) });
+            } else if (mode == Mode::IdList) {
+                auto numIds = decodeVarInt(query);
+                for (uint64_t i = 0; i < numIds; i++) getBytes(query, ID_SIZE);
+            } else if (mode != Mode::Skip) {
+                throw negentropy::err("unexpected mode");
+            }
+
+            prevIndex = upper;
+            numRanges++;
+        }
+
+        lastTimestampIn = origTimestampIn;
 
+        std::vector<std::optional<PrecomputedRange>> output(numRanges);
+        std::atomic<size_t> nextJob = 0;
+        std::exception_ptr error;
+        std::mutex errorMutex;
+
+        auto worker = [&]{
+            try {
+                size_t j;
+                while ((j = nextJob++) < jobs.size()) {
+                    auto &job = jobs[j];
+                    auto &res = output[job.rangeIndex].emplace();
+
+                    res.fingerprint = storageFingerprint(job.lower, job.upper);
+                    if (res.fingerprint.sv() != job.theirFingerprint && job.upper - job.lower >= BUCKETS * 2) {
+                        res.buckets = storageFingerprintBuckets(job.lower, job.upper, BUCKETS);
+                    }
+                }
+            } catch (...) {
+                std::lock_guard<std::mutex> guard(errorMutex);
+                if (!error) error = std::current_exception();
+                nextJob = jobs.size();
+            }
+        };
+
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < std::min(reconcileThreads, jobs.size()); i++) threads.emplace_back(worker);
+        worker();
+        for (auto &t : threads) t.join();
+
+        if (error) std::rethrow_exception(error);
+
+        return output;
+    }
+
+    void splitRange(std::string &o, size_t lower, size_t upper, const Bound &upperBound, const std::vector<Bucket> *precomputedBuckets = nullptr) {
         uint64_t numElems = upper - lower;
-        const uint64_t buckets = 16;
+        const uint64_t buckets = BUCKETS;
 
         if (numElems < buckets * 2) {
-            o += encodeBound(upperBound);
-            o += encodeVarInt(uint64_t(Mode::IdList));
+            encodeBound(o, upperBound);
+            encodeVarInt(o, uint64_t(Mode::IdList));
 
-            o += encodeVarInt(numElems);
-            storage.iterate(lower, upper, [&](const Item &item, size_t){
+            encodeVarInt(o, numElems);
+            iterateStorage(lower, upper, [&](const Item &item, size_t){
                 o += item.getId();
                 return true;
             });
         } else {
-            uint64_t itemsPerBucket = numElems / buckets;
-            uint64_t bucketsWithExtra = numElems % buckets;
-            auto curr = lower;
+            std::vector<Bucket> computedBuckets;
+            if (!precomputedBuckets || precomputedBuckets->empty()) {
+                computedBuckets = storageFingerprintBuckets(lower, upper, buckets);
+                precomputedBuckets = &computedBuckets;
+            }
+            const auto &summaries = *precomputedBuckets;
 
             for (uint64_t i = 0; i < buckets; i++) {
-                auto bucketSize = itemsPerBucket + (i < bucketsWithExtra ? 1 : 0);
-                auto ourFingerprint = storage.fingerprint(curr, curr + bucketSize);
-                curr += bucketSize;
-
                 Bound nextBound;
 
-                if (curr == upper) {
+                if (i == buckets - 1) {
                     nextBound = upperBound;
                 } else {
-                    Item prevItem, currItem;
-
-                    storage.iterate(curr - 1, curr + 1, [&](const Item &item, size_t index){
-                        if (index == curr - 1) prevItem = item;
-                        else currItem = item;
-                        return true;
-                    });
-
-                    nextBound = getMinimalBound(prevItem, currItem);
+                    nextBound = getMinimalBound(summaries[i].lastItem, summaries[i + 1].firstItem);
                 }
 
-                o += encodeBound(nextBound);
-                o += encodeVarInt(uint64_t(Mode::Fingerprint));
-                o += ourFingerprint.sv();
+                encodeBound(o, nextBound);
+                encodeVarInt(o, uint64_t(Mode::Fingerprint));
+                o += summaries[i].fingerprint.sv();
             }
         }
+    }
 
-        return o;
+    // Storage access. When StorageImpl is a concrete type, calls are qualified with it to bypass
+    // virtual dispatch, so they can be inlined. Only abstract interfaces (StorageBase) use the vtable.
+
+    static constexpr bool staticDispatch = !std::is_abstract_v<StorageImpl>;
+
+    uint64_t getStorageSize() {
+        if constexpr (staticDispatch) return storage.StorageImpl::size();
+        else return storage.size();
+    }
+
+    size_t storageFindLowerBound(size_t begin, size_t end, const Bound &bound) {
+        if constexpr (staticDispatch) return storage.StorageImpl::findLowerBound(begin, end, bound);
+        else return storage.findLowerBound(begin, end, bound);
+    }
+
+    Fingerprint storageFingerprint(size_t begin, size_t end) {
+        if constexpr (staticDispatch) return storage.StorageImpl::fingerprint(begin, end);
+        else return storage.fingerprint(begin, end);
+    }
+
+    std::vector<Bucket> storageFingerprintBuckets(size_t begin, size_t end, size_t numBuckets) {
+        if constexpr (staticDispatch) return storage.StorageImpl::fingerprintBuckets(begin, end, numBuckets);
+        else return storage.fingerprintBuckets(begin, end, numBuckets);
+    }
+
+    // Uses the storage's inlinable forEach() if it has one, otherwise iterate()
+
+    template<typename F>
+    void iterateStorage(size_t begin, size_t end, F &&cb) {
+        if constexpr (requires { storage.forEach(begin, end, cb); }) {
+            storage.forEach(begin, end, cb);
+        } else if constexpr (staticDispatch) {
+            storage.StorageImpl::iterate(begin, end, cb);
+        } else {
+            storage.iterate(begin, end, cb);
+        }
     }
 
     bool exceededFrameSizeLimit(size_t n) {
@@ -277,26 +453,25 @@ struct Negentropy {
 
     // Encoding
 
-    std::string encodeTimestampOut(uint64_t timestamp) {
+    // These append to output
+
+    void encodeTimestampOut(std::string &output, uint64_t timestamp) {
         if (timestamp == MAX_U64) {
             lastTimestampOut = MAX_U64;
-            return encodeVarInt(0);
+            encodeVarInt(output, 0);
+            return;
         }
 
         uint64_t temp = timestamp;
         timestamp -= lastTimestampOut;
         lastTimestampOut = temp;
-        return encodeVarInt(timestamp + 1);
+        encodeVarInt(output, timestamp + 1);
     };
 
-    std::string encodeBound(const Bound &bound) {
-        std::string output;
-
-        output += encodeTimestampOut(bound.item.timestamp);
-        output += encodeVarInt(bound.idLen);
+    void encodeBound(std::string &output, const Bound &bound) {
+        encodeTimestampOut(output, bound.item.timestamp);
+        encodeVarInt(output, bound.idLen);
         output += bound.item.getId().substr(0, bound.idLen);
-
-        return output;
     };
 
     Bound getMinimalBound(const Item &prev, const Item &curr) {
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+
+#include "negentropy.h"
+#include "negentropy/storage/FingerprintCache.h"
+
+
+
+namespace negentropy {
+
+
+// Serves many concurrent non-initiator sessions over one storage snapshot. Fingerprints are shared
+// between sessions using a FingerprintCache, so ranges that every client asks about (such as the
+// top-level buckets of an initial sync) are only computed once.
+//
+// The storage must not be modified while sessions are open. If sessions are used from multiple
+// threads, the storage must also support concurrent reads.
+
+template<typename StorageImpl>
+struct SessionManager {
+    StorageImpl &storage;
+    uint64_t frameSizeLimit;
+
+    size_t maxSessions = 10'000;
+    size_t sessionMemoryBudget = 0; // max bytes of query plus response for one message, 0 for unlimited
+
+    storage::FingerprintCache cache; // shared by all sessions
+
+    SessionManager(StorageImpl &storage, uint64_t frameSizeLimit = 0) : storage(storage), frameSizeLimit(frameSizeLimit), cache(storage) {
+        if (frameSizeLimit != 0 && frameSizeLimit < 4096) throw negentropy::err("frameSizeLimit too small");
+    }
+
+    // Creates a session (replacing any existing one with the same ID) and responds to its first message
+
+    std::string open(const std::string &sessionId, std::string_view query) {
+        auto session = std::make_shared<Session>(cache);
+
+        {
+            std::lock_guard<std::mutex> guard(sessionsMutex);
+            auto it = sessions.find(sessionId);
+            if (it != sessions.end()) it->second = session;
+            else if (sessions.size() >= maxSessions) throw negentropy::err("too many sessions");
+            else sessions.emplace(sessionId, session);
+        }
+
+        try {
+            return reconcileSession(*session, query);
+        } catch (...) {
+            close(sessionId);
+            throw;
+        }
+    }
+
+    std::string reconcile(const std::string &sessionId, std::string_view query) {
+        std::shared_ptr<Session> session;
+
+        {
+            std::lock_guard<std::mutex> guard(sessionsMutex);
+            auto it = sessions.find(sessionId);
+            if (it == sessions.end()) throw negentropy::err("unknown session");
+            session = it->second;
+        }
+
+        return reconcileSession(*session, query);
+    }
+
+    void close(const std::string &sessionId) {
+        std::lock_guard<std::mutex> guard(sessionsMutex);
+        sessions.erase(sessionId);
+    }
+
+    size_t numSessions() {
+        std::lock_guard<std::mutex> guard(sessionsMutex);
+        return sessions.size();
+    }
+
+    void clearCache() {
+        cache.clear();
+    }
+
+  private:
+    struct Session {
+        std::mutex mutex;
+        Negentropy<storage::FingerprintCache> ne;
+
+        Session(storage::FingerprintCache &cache) : ne(cache) {}
+    };
+
+    std::mutex sessionsMutex;
+    std::unordered_map<std::string, std::shared_ptr<Session>> sessions;
+
+    std::string reconcileSession(Session &session, std::string_view query) {
+        // The query is held while its response is built, so both count against the budget
+
+        uint64_t limit = frameSizeLimit;
+
+        if (sessionMemoryBudget) {
+            if (query.size() + 4096 > sessionMemoryBudget) throw negentropy::err("query exceeds session memory budget");
+            uint64_t remaining = sessionMemoryBudget - query.size();
+            if (limit == 0 || remaining < limit) limit = remaining;
+        }
+
+        std::lock_guard<std::mutex> guard(session.mutex);
+        session.ne.frameSizeLimit = limit;
+        return session.ne.reconcile(query);
+    }
+};
+
+
+}
@@ -2,6 +2,7 @@
 
 #include <stdint.h>
 
+#include <string>
 #include <string_view>
 
 
@@ -18,45 +19,58 @@ inline uint8_t getByte(std::string_view &encoded) {
     return output;
 }
 
-inline std::string getBytes(std::string_view &encoded, size_t n) {
+// Returns a view into the encoded buffer, which must outlive the returned value
+
+inline std::string_view getBytes(std::string_view &encoded, size_t n) {
     if (encoded.size() < n) throw negentropy::err("parse ends prematurely");
     auto res = encoded.substr(0, n);
-    encoded = encoded.substr(n);
-    return std::string(res);
+    encoded.remove_prefix(n);
+    return res;
 };
 
 inline uint64_t decodeVarInt(std::string_view &encoded) {
+    auto p = reinterpret_cast<const uint8_t*>(encoded.data());
+    size_t len = encoded.size();
+    size_t i = 0;
     uint64_t res = 0;
 
     while (1) {
-        if (encoded.size() == 0) throw negentropy::err("premature end of varint");
-        uint64_t byte = encoded[0];
-        encoded = encoded.substr(1);
+        if (i == len) throw negentropy::err("premature end of varint");
+        uint64_t byte = p[i++];
         res = (res << 7) | (byte & 0b0111'1111);
         if ((byte & 0b1000'0000) == 0) break;
     }
 
+    encoded.remove_prefix(i);
     return res;
 }
 
-inline std::string encodeVarInt(uint64_t n) {
-    if (n == 0) return std::string(1, '\0');
+const size_t MAX_VARINT_SIZE = 10;
+
+// Encodes n into the end of buf, without allocating. Returns a view of the encoded bytes.
+
+inline std::string_view encodeVarInt(uint64_t n, char (&buf)[MAX_VARINT_SIZE]) {
+    size_t i = MAX_VARINT_SIZE;
 
-    std::string o;
+    buf[--i] = static_cast<char>(n & 0x7F);
+    n >>= 7;
 
     while (n) {
-        o.push_back(static_cast<unsigned char>(n & 0x7F));
+        buf[--i] = static_cast<char>(0x80 | (n & 0x7F));
         n >>= 7;
     }
 
-    std::reverse(o.begin(), o.end());
-
-    for (size_t i = 0; i < o.size() - 1; i++) {
-        o[i] |= 0x80;
-    }
+    return std::string_view(buf + i, MAX_VARINT_SIZE - i);
+}
 
-    return o;
+inline void encodeVarInt(std::string &output, uint64_t n) {
+    char buf[MAX_VARINT_SIZE];
+    output += encodeVarInt(n, buf);
 }
 
+inline std::string encodeVarInt(uint64_t n) {
+    char buf[MAX_VARINT_SIZE];
+    return std::string(encodeVarInt(n, buf));
+}
 
 }
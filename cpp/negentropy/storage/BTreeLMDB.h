@@ -1,11 +1,10 @@
 #pragma once
 
-#include <map>
-
 #include "lmdbxx/lmdb++.h"
 
 #include "negentropy.h"
 #include "negentropy/storage/btree/core.h"
+#include "negentropy/storage/btree/arena.h"
 
 
 namespace negentropy { namespace storage {
@@ -15,49 +14,109 @@ using Node = negentropy::storage::btree::Node;
 using NodePtr = negentropy::storage::btree::NodePtr;
 
 
-struct BTreeLMDB : btree::BTreeCore {
+// How nodes are stored in the DB. This is chosen when a tree is created, and recorded in its metadata.
+
+enum class BTreeLMDBNodeFormat : uint64_t {
+    Raw = 0, // The btree::Node struct, as-is
+    Compact = 1, // Variable-length records, see BasicBTreeLMDB::encodeNode()
+};
+
+
+// The geometry must be the same whenever a tree is opened. This is checked for Raw-format trees.
+
+template<typename G = btree::DefaultGeometry>
+struct BasicBTreeLMDB : btree::BTreeCore<BasicBTreeLMDB<G>, G> {
+    using Node = btree::BasicNode<G>;
+    using NodePtr = btree::BasicNodePtr<G>;
+
     lmdb::txn &txn;
     lmdb::dbi dbi;
     uint64_t treeId;
 
+    using NodeFormat = BTreeLMDBNodeFormat;
+
+    // Trees in the Raw format have 16-byte metadata records (without formatVersion), as in
+    // earlier versions of this library.
+
     struct MetaData {
         uint64_t rootNodeId;
         uint64_t nextNodeId;
+        uint64_t formatVersion;
 
         bool operator==(const MetaData &other) const {
-            return rootNodeId == other.rootNodeId && nextNodeId == other.nextNodeId;
+            return rootNodeId == other.rootNodeId && nextNodeId == other.nextNodeId && formatVersion == other.formatVersion;
         }
     };
 
     MetaData metaDataCache;
     MetaData origMetaData;
-    std::map<uint64_t, Node> dirtyNodeCache;
+    btree::BasicNodeArena<Node> dirtyNodeCache;
+
+    // In the Compact format, nodes are decoded when first read and kept here until the next flush().
+    // flush() may also be called in read-only transactions, to release memory.
+    btree::BasicNodeArena<Node> decodedNodeCache;
+
+    // When the environment is opened with MDB_WRITEMAP, nodes are modified in place: getNodeWrite()
+    // and makeNode() reserve the node's value with MDB_RESERVE and the tree writes straight into the
+    // map, so flush() has no nodes to copy. This relies on nodes being big enough to go on overflow
+    // pages, which don't move while other keys are written. Without MDB_WRITEMAP, LMDB may spill
+    // and free dirty pages during a write transaction, so nodes are copied into dirtyNodeCache instead.
+    bool inPlaceWrites = false;
 
 
     static lmdb::dbi setupDB(lmdb::txn &txn, std::string_view tableName) {
         return lmdb::dbi::open(txn, tableName, MDB_CREATE | MDB_REVERSEKEY);
     }
 
-    BTreeLMDB(lmdb::txn &txn, lmdb::dbi dbi, uint64_t treeId) : txn(txn), dbi(dbi), treeId(treeId) {
-        static_assert(sizeof(MetaData) == 16);
+    // newTreeFormat is only used if the tree doesn't exist yet. Existing trees keep their format.
+
+    BasicBTreeLMDB(lmdb::txn &txn, lmdb::dbi dbi, uint64_t treeId, NodeFormat newTreeFormat = NodeFormat::Raw) : txn(txn), dbi(dbi), treeId(treeId) {
+        static_assert(sizeof(MetaData) == 24);
         std::string_view v;
         bool found = dbi.get(txn, getKey(0), v);
-        metaDataCache = found ? lmdb::from_sv<MetaData>(v) : MetaData{ 0, 1, };
+        metaDataCache = found ? decodeMetaData(v) : MetaData{ 0, 1, uint64_t(newTreeFormat), };
         origMetaData = metaDataCache;
+
+        MDB_env *env = mdb_txn_env(txn);
+        unsigned int envFlags;
+        MDB_stat stat;
+        if (mdb_env_get_flags(env, &envFlags) == 0 && mdb_env_stat(env, &stat) == 0) {
+            inPlaceWrites = (envFlags & MDB_WRITEMAP) && sizeof(Node) > stat.ms_psize / 2 && !isCompact();
+        }
+    }
+
+    NodeFormat format() const {
+        return NodeFormat(metaDataCache.formatVersion);
     }
 
-    ~BTreeLMDB() {
+    ~BasicBTreeLMDB() {
         flush();
     }
 
+    // Nodes are written in nodeId order. Those created since the last flush usually have the
+    // highest keys in the DB, so MDB_APPEND is tried first. MDB_RESERVE lets each node be copied
+    // straight into its LMDB page. In-place nodes are already in their pages.
+
     void flush() {
-        for (auto &[nodeId, node] : dirtyNodeCache) {
-            dbi.put(txn, getKey(nodeId), node.sv());
+        bool tryAppend = true;
+
+        for (const auto &slot : dirtyNodeCache.sorted()) {
+            if (!slot.owned) continue;
+
+            if (isCompact()) {
+                encodeNode(*slot.node, encodeBuf);
+                memcpy(reserveNode(slot.nodeId, tryAppend, encodeBuf.size()), encodeBuf.data(), encodeBuf.size());
+            } else {
+                memcpy(reserveNode(slot.nodeId, tryAppend), slot.node, sizeof(Node));
+            }
         }
+
         dirtyNodeCache.clear();
+        decodedNodeCache.clear();
+        tryAppendInPlace = true;
 
         if (metaDataCache != origMetaData) {
-            dbi.put(txn, getKey(0), lmdb::to_sv<MetaData>(metaDataCache));
+            dbi.put(txn, getKey(0), encodeMetaData(metaDataCache));
             origMetaData = metaDataCache;
         }
     }
@@ -65,47 +124,68 @@ struct BTreeLMDB : btree::BTreeCore {
 
     // Interface
 
-    const btree::NodePtr getNodeRead(uint64_t nodeId) {
+    const NodePtr getNodeRead(uint64_t nodeId) {
         if (nodeId == 0) return {nullptr, 0};
 
-        auto res = dirtyNodeCache.find(nodeId);
-        if (res != dirtyNodeCache.end()) return NodePtr{&res->second, nodeId};
+        if (Node *node = dirtyNodeCache.find(nodeId)) return NodePtr{node, nodeId};
 
-        std::string_view sv;
-        bool found = dbi.get(txn, getKey(nodeId), sv);
-        if (!found) throw err("couldn't find node");
-        return NodePtr{(Node*)sv.data(), nodeId};
+        if (isCompact()) {
+            if (Node *node = decodedNodeCache.find(nodeId)) return NodePtr{node, nodeId};
+            Node *node = decodedNodeCache.insert(nodeId);
+            decodeNode(getNodeValue(nodeId), *node);
+            return NodePtr{node, nodeId};
+        }
+
+        return NodePtr{(Node*)getNodeValue(nodeId).data(), nodeId};
     }
 
-    btree::NodePtr getNodeWrite(uint64_t nodeId) {
+    NodePtr getNodeWrite(uint64_t nodeId) {
         if (nodeId == 0) return {nullptr, 0};
 
-        {
-            auto res = dirtyNodeCache.find(nodeId);
-            if (res != dirtyNodeCache.end()) return NodePtr{&res->second, nodeId};
+        if (Node *node = dirtyNodeCache.find(nodeId)) return NodePtr{node, nodeId};
+
+        if (isCompact()) {
+            // Any decoded copy is left alone, since it may still be referenced. It is shadowed
+            // by the dirty node until flush() clears both.
+            Node *newNode = dirtyNodeCache.insert(nodeId);
+            if (Node *node = decodedNodeCache.find(nodeId)) memcpy(newNode, node, sizeof(Node));
+            else decodeNode(getNodeValue(nodeId), *newNode);
+            return NodePtr{newNode, nodeId};
         }
 
-        std::string_view sv;
-        bool found = dbi.get(txn, getKey(nodeId), sv);
-        if (!found) throw err("couldn't find node");
+        std::string_view sv = getNodeValue(nodeId);
 
-        auto res = dirtyNodeCache.try_emplace(nodeId);
-        Node *newNode = &res.first->second;
+        if (inPlaceWrites) {
+            // If the node's page is already dirty, LMDB returns the same address. Otherwise the
+            // old page is left untouched until commit, so it can be copied from.
+            Node *newNode = static_cast<Node*>(reserveNode(nodeId, tryAppendInPlace));
+            if ((void*)newNode != (void*)sv.data()) memcpy(newNode, sv.data(), sizeof(Node));
+            dirtyNodeCache.insertExternal(nodeId, newNode);
+            return NodePtr{newNode, nodeId};
+        }
+
+        Node *newNode = dirtyNodeCache.insert(nodeId);
         memcpy(newNode, sv.data(), sizeof(Node));
 
         return NodePtr{newNode, nodeId};
     }
 
-    btree::NodePtr makeNode() {
+    NodePtr makeNode() {
         uint64_t nodeId = metaDataCache.nextNodeId++;
-        auto res = dirtyNodeCache.try_emplace(nodeId);
-        return NodePtr{&res.first->second, nodeId};
+
+        if (inPlaceWrites) {
+            Node *newNode = new (reserveNode(nodeId, tryAppendInPlace)) Node();
+            dirtyNodeCache.insertExternal(nodeId, newNode);
+            return NodePtr{newNode, nodeId};
+        }
+
+        return NodePtr{dirtyNodeCache.insert(nodeId), nodeId};
     }
 
     void deleteNode(uint64_t nodeId) {
         if (nodeId == 0) throw err("can't delete metadata");
         dirtyNodeCache.erase(nodeId);
-        dbi.del(txn, getKey(nodeId));
+        if (inPlaceWrites || nodeId < origMetaData.nextNodeId) dbi.del(txn, getKey(nodeId)); // otherwise never written
     }
 
     uint64_t getRootNodeId() {
@@ -118,7 +198,113 @@ struct BTreeLMDB : btree::BTreeCore {
 
     // Internal utils
 
+    // Compact format (version 1), all integers are varints:
+    //
+    //   hasChildren, numItems, accumCount, nextSibling, prevSibling, accum (32 bytes)
+    //   Then for each item: timestamp delta from previous item, id (32 bytes), child nodeId (if hasChildren)
+    //
+    // Leaves don't store child nodeIds, and only numItems items are stored.
+
+    static void encodeNode(const Node &node, std::string &out) {
+        bool hasChildren = node.numItems && node.items[0].nodeId;
+
+        out.clear();
+        encodeVarInt(out, hasChildren);
+        encodeVarInt(out, node.numItems);
+        encodeVarInt(out, node.accumCount);
+        encodeVarInt(out, node.nextSibling);
+        encodeVarInt(out, node.prevSibling);
+        out += std::string_view(reinterpret_cast<const char*>(node.accum.buf), sizeof(node.accum.buf));
+
+        uint64_t prevTimestamp = 0;
+
+        for (size_t i = 0; i < node.numItems; i++) {
+            const auto &key = node.items[i];
+            if (key.item.timestamp < prevTimestamp) throw err("node items out of order");
+            encodeVarInt(out, key.item.timestamp - prevTimestamp);
+            prevTimestamp = key.item.timestamp;
+            out += std::string_view(reinterpret_cast<const char*>(key.item.id), ID_SIZE);
+            if (hasChildren) encodeVarInt(out, key.nodeId);
+        }
+    }
+
+    // node must be zeroed
+
+    static void decodeNode(std::string_view encoded, Node &node) {
+        bool hasChildren = decodeVarInt(encoded);
+        node.numItems = decodeVarInt(encoded);
+        if (node.numItems > G::MAX_ITEMS + 1) throw err("corrupt node: too many items");
+        node.accumCount = decodeVarInt(encoded);
+        node.nextSibling = decodeVarInt(encoded);
+        node.prevSibling = decodeVarInt(encoded);
+        memcpy(node.accum.buf, getBytes(encoded, sizeof(node.accum.buf)).data(), sizeof(node.accum.buf));
+
+        uint64_t timestamp = 0;
+
+        for (size_t i = 0; i < node.numItems; i++) {
+            auto &key = node.items[i];
+            timestamp += decodeVarInt(encoded);
+            key.item.timestamp = timestamp;
+            memcpy(key.item.id, getBytes(encoded, ID_SIZE).data(), ID_SIZE);
+            if (hasChildren) key.nodeId = decodeVarInt(encoded);
+        }
+
+        if (encoded.size()) throw err("corrupt node: trailing bytes");
+    }
+
+
   private:
+    bool tryAppendInPlace = true;
+    std::string encodeBuf;
+
+    bool isCompact() const {
+        return metaDataCache.formatVersion == uint64_t(NodeFormat::Compact);
+    }
+
+    static MetaData decodeMetaData(std::string_view v) {
+        MetaData m{};
+
+        if (v.size() == 16) {
+            memcpy(&m, v.data(), 16);
+        } else if (v.size() == sizeof(MetaData)) {
+            memcpy(&m, v.data(), sizeof(MetaData));
+            if (m.formatVersion != uint64_t(NodeFormat::Compact)) throw err("unsupported node format");
+        } else {
+            throw err("unexpected metadata size");
+        }
+
+        return m;
+    }
+
+    static std::string_view encodeMetaData(const MetaData &m) {
+        auto v = lmdb::to_sv<MetaData>(m);
+        return m.formatVersion == uint64_t(NodeFormat::Raw) ? v.substr(0, 16) : v;
+    }
+
+    std::string_view getNodeValue(uint64_t nodeId) {
+        std::string_view sv;
+        bool found = dbi.get(txn, getKey(nodeId), sv);
+        if (!found) throw err("couldn't find node");
+        if (!isCompact() && sv.size() != sizeof(Node)) throw err("node size mismatch: tree was created with a different geometry");
+        return sv;
+    }
+
+    // Reserves space for a node in the DB. MDB_APPEND is attempted for new nodes until it fails once.
+    void *reserveNode(uint64_t nodeId, bool &tryAppend, size_t size = sizeof(Node)) {
+        auto key = getKey(nodeId);
+        MDB_val k{ key.size(), key.data() };
+        MDB_val v{ size, nullptr };
+
+        bool isNew = nodeId >= origMetaData.nextNodeId;
+
+        if (!(isNew && tryAppend && lmdb::dbi_put(txn, dbi.handle(), &k, &v, MDB_RESERVE | MDB_APPEND))) {
+            if (isNew) tryAppend = false;
+            lmdb::dbi_put(txn, dbi.handle(), &k, &v, MDB_RESERVE);
+        }
+
+        return v.mv_data;
+    }
+
     std::string getKey(uint64_t n) {
         uint64_t treeIdCopy = treeId;
 
@@ -142,5 +328,7 @@ struct BTreeLMDB : btree::BTreeCore {
     }
 };
 
+using BTreeLMDB = BasicBTreeLMDB<>;
+
 
 }}
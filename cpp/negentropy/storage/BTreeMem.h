@@ -1,5 +1,7 @@
 #pragma once
 
+#include <unordered_map>
+
 #include "negentropy.h"
 #include "negentropy/storage/btree/core.h"
 
@@ -7,25 +9,29 @@
 namespace negentropy { namespace storage {
 
 
-struct BTreeMem : btree::BTreeCore {
-    std::unordered_map<uint64_t, btree::Node> _nodeStorageMap;
+template<typename G = btree::DefaultGeometry>
+struct BasicBTreeMem : btree::BTreeCore<BasicBTreeMem<G>, G> {
+    using Node = btree::BasicNode<G>;
+    using NodePtr = btree::BasicNodePtr<G>;
+
+    std::unordered_map<uint64_t, Node> _nodeStorageMap;
     uint64_t _rootNodeId = 0; // 0 means no root
     uint64_t _nextNodeId = 1;
 
     // Interface
 
-    const btree::NodePtr getNodeRead(uint64_t nodeId) {
+    const NodePtr getNodeRead(uint64_t nodeId) {
         if (nodeId == 0) return {nullptr, 0};
         auto res = _nodeStorageMap.find(nodeId);
-        if (res == _nodeStorageMap.end()) return btree::NodePtr{nullptr, 0};
-        return btree::NodePtr{&res->second, nodeId};
+        if (res == _nodeStorageMap.end()) return NodePtr{nullptr, 0};
+        return NodePtr{&res->second, nodeId};
     }
 
-    btree::NodePtr getNodeWrite(uint64_t nodeId) {
+    NodePtr getNodeWrite(uint64_t nodeId) {
         return getNodeRead(nodeId);
     }
 
-    btree::NodePtr makeNode() {
+    NodePtr makeNode() {
         uint64_t nodeId = _nextNodeId++;
         _nodeStorageMap.try_emplace(nodeId);
         return getNodeRead(nodeId);
@@ -44,5 +50,7 @@ struct BTreeMem : btree::BTreeCore {
     }
 };
 
+using BTreeMem = BasicBTreeMem<>;
+
 
 }}
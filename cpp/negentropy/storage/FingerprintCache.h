@@ -0,0 +1,268 @@
+#pragma once
+
+#include <list>
+#include <unordered_map>
+#include <mutex>
+
+#include "negentropy.h"
+
+
+
+namespace negentropy { namespace storage {
+
+
+// Wraps another storage, remembering the results of recent fingerprint() and findLowerBound() calls
+// in size-bounded LRU tables. Everything is discarded whenever the base storage's version() changes,
+// so the base storage must report one.
+// Safe to call from multiple threads, if the base storage supports concurrent reads.
+
+struct FingerprintCache : StorageBase {
+    StorageBase &base;
+    size_t maxEntries; // per table
+
+    struct Stats {
+        uint64_t fingerprintHits = 0;
+        uint64_t fingerprintMisses = 0;
+        uint64_t lowerBoundHits = 0;
+        uint64_t lowerBoundMisses = 0;
+        uint64_t invalidations = 0;
+    };
+
+    FingerprintCache(StorageBase &base, size_t maxEntries = 100'000) : base(base), maxEntries(maxEntries) {
+        cachedVersion = getBaseVersion();
+    }
+
+    uint64_t size() {
+        return base.size();
+    }
+
+    const Item &getItem(size_t i) {
+        return base.getItem(i);
+    }
+
+    void iterate(size_t begin, size_t end, std::function<bool(const Item &, size_t)> cb) {
+        base.iterate(begin, end, cb);
+    }
+
+    size_t findLowerBound(size_t begin, size_t end, const Bound &bound) {
+        LowerBoundKey key{ begin, end, bound.item };
+
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            checkVersion();
+            if (auto *res = lowerBounds.get(key)) {
+                stats.lowerBoundHits++;
+                return *res;
+            }
+            stats.lowerBoundMisses++;
+        }
+
+        auto res = base.findLowerBound(begin, end, bound);
+
+        std::lock_guard<std::mutex> guard(mutex);
+        lowerBounds.put(key, res, maxEntries);
+        return res;
+    }
+
+    Fingerprint fingerprint(size_t begin, size_t end) {
+        RangeKey key{ begin, end };
+
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            checkVersion();
+            if (auto *cached = fingerprints.get(key)) {
+                stats.fingerprintHits++;
+                return cached->bucket.fingerprint;
+            }
+            stats.fingerprintMisses++;
+        }
+
+        auto fp = base.fingerprint(begin, end);
+
+        std::lock_guard<std::mutex> guard(mutex);
+        if (!fingerprints.get(key)) {
+            CachedRange cached;
+            cached.bucket.fingerprint = fp;
+            fingerprints.put(key, cached, maxEntries);
+        }
+
+        return fp;
+    }
+
+    // Buckets are cached along with their boundary items. If every bucket is cached, the base storage
+    // is only consulted for the boundary items of ranges that were cached by fingerprint(). Otherwise
+    // the base storage computes them all (usually in one pass), and they are added to the cache.
+
+    std::vector<Bucket> fingerprintBuckets(size_t begin, size_t end, size_t numBuckets) {
+        std::vector<Bucket> out(numBuckets);
+        std::vector<size_t> needItems;
+        bool allCached = true;
+
+        {
+            std::lock_guard<std::mutex> guard(mutex);
+            checkVersion();
+
+            for (size_t i = 0; i < numBuckets; i++) {
+                auto *cached = fingerprints.get({ bucketBoundary(begin, end, numBuckets, i), bucketBoundary(begin, end, numBuckets, i + 1) });
+                if (!cached) {
+                    allCached = false;
+                    break;
+                }
+                out[i] = cached->bucket;
+                if (!cached->hasItems) needItems.push_back(i);
+            }
+
+            if (allCached) stats.fingerprintHits += numBuckets;
+            else stats.fingerprintMisses += numBuckets;
+        }
+
+        if (allCached) {
+            for (size_t i : needItems) {
+                size_t bucketBegin = bucketBoundary(begin, end, numBuckets, i);
+                size_t bucketEnd = bucketBoundary(begin, end, numBuckets, i + 1);
+
+                if (bucketBegin != bucketEnd) {
+                    out[i].firstItem = base.getItem(bucketBegin);
+                    out[i].lastItem = base.getItem(bucketEnd - 1);
+                }
+            }
+
+            if (needItems.size()) putBuckets(begin, end, out);
+            return out;
+        }
+
+        out = base.fingerprintBuckets(begin, end, numBuckets);
+        putBuckets(begin, end, out);
+        return out;
+    }
+
+    std::optional<uint64_t> version() {
+        return base.version();
+    }
+
+    Stats getStats() {
+        std::lock_guard<std::mutex> guard(mutex);
+        return stats;
+    }
+
+    void resetStats() {
+        std::lock_guard<std::mutex> guard(mutex);
+        stats = Stats{};
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> guard(mutex);
+        fingerprints.clear();
+        lowerBounds.clear();
+    }
+
+  private:
+    struct CachedRange {
+        Bucket bucket;
+        bool hasItems = false; // false if cached by fingerprint(), which doesn't know the boundary items
+    };
+
+    struct RangeKey {
+        size_t begin;
+        size_t end;
+
+        bool operator==(const RangeKey &other) const = default;
+    };
+
+    struct LowerBoundKey {
+        size_t begin;
+        size_t end;
+        Item item;
+
+        bool operator==(const LowerBoundKey &other) const {
+            return begin == other.begin && end == other.end && item == other.item;
+        }
+    };
+
+    struct KeyHash {
+        static size_t mix(size_t h, uint64_t v) {
+            return (h ^ v) * 0x9E3779B97F4A7C15ULL;
+        }
+
+        size_t operator()(const RangeKey &k) const {
+            return mix(mix(0, k.begin), k.end);
+        }
+
+        size_t operator()(const LowerBoundKey &k) const {
+            uint64_t idPrefix;
+            memcpy(&idPrefix, k.item.id, sizeof(idPrefix));
+            return mix(mix(mix(mix(0, k.begin), k.end), k.item.timestamp), idPrefix);
+        }
+    };
+
+    template<typename K, typename V>
+    struct LruTable {
+        std::list<std::pair<K, V>> entries; // most recently used first
+        std::unordered_map<K, typename std::list<std::pair<K, V>>::iterator, KeyHash> index;
+
+        const V *get(const K &key) {
+            auto it = index.find(key);
+            if (it == index.end()) return nullptr;
+            entries.splice(entries.begin(), entries, it->second);
+            return &it->second->second;
+        }
+
+        // Replaces the value if key is already present
+        void put(const K &key, const V &val, size_t maxEntries) {
+            if (maxEntries == 0) return;
+
+            if (auto it = index.find(key); it != index.end()) {
+                it->second->second = val;
+                entries.splice(entries.begin(), entries, it->second);
+                return;
+            }
+
+            while (index.size() >= maxEntries) {
+                index.erase(entries.back().first);
+                entries.pop_back();
+            }
+
+            entries.emplace_front(key, val);
+            index.emplace(key, entries.begin());
+        }
+
+        void clear() {
+            index.clear();
+            entries.clear();
+        }
+    };
+
+    std::mutex mutex;
+    uint64_t cachedVersion;
+    Stats stats;
+    LruTable<RangeKey, CachedRange> fingerprints;
+    LruTable<LowerBoundKey, size_t> lowerBounds;
+
+    void putBuckets(size_t begin, size_t end, const std::vector<Bucket> &buckets) {
+        std::lock_guard<std::mutex> guard(mutex);
+
+        for (size_t i = 0; i < buckets.size(); i++) {
+            fingerprints.put({ bucketBoundary(begin, end, buckets.size(), i), bucketBoundary(begin, end, buckets.size(), i + 1) }, CachedRange{ buckets[i], true }, maxEntries);
+        }
+    }
+
+    uint64_t getBaseVersion() {
+        auto v = base.version();
+        if (!v) throw negentropy::err("FingerprintCache requires a storage that reports its version()");
+        return *v;
+    }
+
+    // Must be called with mutex held
+    void checkVersion() {
+        auto currVersion = getBaseVersion();
+        if (currVersion == cachedVersion) return;
+
+        fingerprints.clear();
+        lowerBounds.clear();
+        cachedVersion = currVersion;
+        stats.invalidations++;
+    }
+};
+
+
+}}
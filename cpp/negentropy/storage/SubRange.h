@@ -53,6 +53,16 @@ struct SubRange : StorageBase {
         return base.fingerprint(subBegin + begin, subBegin + end);
     }
 
+    std::vector<Bucket> fingerprintBuckets(size_t begin, size_t end, size_t numBuckets) {
+        checkBounds(begin, end);
+
+        return base.fingerprintBuckets(subBegin + begin, subBegin + end, numBuckets);
+    }
+
+    std::optional<uint64_t> version() {
+        return base.version();
+    }
+
   private:
     void checkBounds(size_t begin, size_t end) {
         if (begin > end || end > subSize) throw negentropy::err("bad range");
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <thread>
+#include <atomic>
+
 #include "negentropy.h"
 
 
@@ -11,10 +14,20 @@ struct Vector : StorageBase {
     std::vector<Item> items;
     bool sealed = false;
 
+    // If non-zero, seal() builds a prefix-sum index holding the accumulator of every
+    // prefixStride'th prefix of items. Fingerprints then cost O(prefixStride) instead of
+    // O(range size), at a memory cost of sizeof(Accumulator) / prefixStride bytes per item.
+    size_t prefixStride = 0;
+    std::vector<Accumulator> prefixAccums; // prefixAccums[i] = sum of items[0 .. i*indexStride)
+
+    // If greater than 1, seal() sorts and checks for duplicates using this many threads
+    size_t sealThreads = 1;
+
     void insert(uint64_t createdAt, std::string_view id) {
         if (sealed) throw negentropy::err("already sealed");
         if (id.size() != ID_SIZE) throw negentropy::err("bad id size for added item");
         items.emplace_back(createdAt, id);
+        currVersion++;
     }
 
     void insertItem(const Item &item) {
@@ -24,16 +37,33 @@ struct Vector : StorageBase {
     void seal() {
         if (sealed) throw negentropy::err("already sealed");
         sealed = true;
+        currVersion++;
 
-        std::sort(items.begin(), items.end());
+        size_t numThreads = std::max(std::min(sealThreads, items.size() / 4096), size_t(1));
 
-        for (size_t i = 1; i < items.size(); i++) {
-            if (items[i - 1] == items[i]) throw negentropy::err("duplicate item inserted");
+        if (numThreads == 1) {
+            std::sort(items.begin(), items.end());
+
+            for (size_t i = 1; i < items.size(); i++) {
+                if (items[i - 1] == items[i]) throw negentropy::err("duplicate item inserted");
+            }
+        } else {
+            sortParallel(numThreads);
+            checkDuplicatesParallel(numThreads);
         }
+
+        buildPrefixIndex();
     }
 
     void unseal() {
         sealed = false;
+        prefixAccums.clear();
+        indexStride = 0;
+        currVersion++;
+    }
+
+    std::optional<uint64_t> version() {
+        return currVersion;
     }
 
     uint64_t size() {
@@ -47,6 +77,13 @@ struct Vector : StorageBase {
     }
 
     void iterate(size_t begin, size_t end, std::function<bool(const Item &, size_t)> cb) {
+        forEach(begin, end, cb);
+    }
+
+    // Same as iterate(), but cb is not type-erased so it can be inlined
+
+    template<typename F>
+    void forEach(size_t begin, size_t end, F &&cb) {
         checkSealed();
         checkBounds(begin, end);
 
@@ -63,18 +100,121 @@ struct Vector : StorageBase {
     }
 
     Fingerprint fingerprint(size_t begin, size_t end) {
+        checkSealed();
+        checkBounds(begin, end);
+
         Accumulator out;
-        out.setToZero();
 
-        iterate(begin, end, [&](const Item &item, size_t){
-            out.add(item);
-            return true;
-        });
+        if (indexStride && (begin % indexStride) + (end % indexStride) < end - begin) {
+            out = getPrefixAccum(end);
+            out.sub(getPrefixAccum(begin));
+        } else {
+            out.setToZero();
+            out.addRange(items.data() + begin, items.data() + end);
+        }
 
         return out.getFingerprint(end - begin);
     }
 
+    std::vector<Bucket> fingerprintBuckets(size_t begin, size_t end, size_t numBuckets) {
+        checkSealed();
+        checkBounds(begin, end);
+
+        std::vector<Bucket> out(numBuckets);
+
+        for (size_t i = 0; i < numBuckets; i++) {
+            size_t bucketBegin = bucketBoundary(begin, end, numBuckets, i);
+            size_t bucketEnd = bucketBoundary(begin, end, numBuckets, i + 1);
+
+            out[i].fingerprint = fingerprint(bucketBegin, bucketEnd);
+
+            if (bucketBegin != bucketEnd) {
+                out[i].firstItem = items[bucketBegin];
+                out[i].lastItem = items[bucketEnd - 1];
+            }
+        }
+
+        return out;
+    }
+
   private:
+    uint64_t currVersion = 0;
+    size_t indexStride = 0; // prefixStride when prefixAccums was built, so later changes to it are harmless
+
+    template<typename F>
+    static void runParallel(size_t numTasks, F f) {
+        std::vector<std::thread> threads;
+        for (size_t i = 1; i < numTasks; i++) threads.emplace_back(f, i);
+        f(0);
+        for (auto &t : threads) t.join();
+    }
+
+    void sortParallel(size_t numThreads) {
+        // Sort equal-sized chunks independently, then merge adjacent pairs of chunks until one remains
+
+        std::vector<size_t> bounds;
+        size_t chunkSize = (items.size() + numThreads - 1) / numThreads;
+        for (size_t i = 0; i < items.size(); i += chunkSize) bounds.push_back(i);
+        bounds.push_back(items.size());
+
+        runParallel(bounds.size() - 1, [&](size_t i){
+            std::sort(items.begin() + bounds[i], items.begin() + bounds[i + 1]);
+        });
+
+        while (bounds.size() > 2) {
+            runParallel((bounds.size() - 1) / 2, [&](size_t i){
+                std::inplace_merge(items.begin() + bounds[i * 2], items.begin() + bounds[i * 2 + 1], items.begin() + bounds[i * 2 + 2]);
+            });
+
+            std::vector<size_t> merged;
+            for (size_t i = 0; i < bounds.size(); i += 2) merged.push_back(bounds[i]);
+            if (merged.back() != items.size()) merged.push_back(items.size());
+            bounds = std::move(merged);
+        }
+    }
+
+    void checkDuplicatesParallel(size_t numThreads) {
+        std::atomic<bool> foundDuplicate = false;
+        size_t chunkSize = (items.size() + numThreads - 1) / numThreads;
+
+        runParallel(numThreads, [&](size_t t){
+            size_t begin = std::max(t * chunkSize, size_t(1));
+            size_t end = std::min((t + 1) * chunkSize, items.size());
+
+            for (size_t i = begin; i < end; i++) {
+                if (items[i - 1] == items[i]) {
+                    foundDuplicate = true;
+                    return;
+                }
+            }
+        });
+
+        if (foundDuplicate) throw negentropy::err("duplicate item inserted");
+    }
+
+    void buildPrefixIndex() {
+        prefixAccums.clear();
+        indexStride = prefixStride;
+        if (indexStride == 0) return;
+
+        Accumulator accum;
+        accum.setToZero();
+        prefixAccums.reserve(items.size() / indexStride + 1);
+        prefixAccums.push_back(accum);
+
+        for (size_t i = indexStride; i <= items.size(); i += indexStride) {
+            accum.addRange(items.data() + i - indexStride, items.data() + i);
+            prefixAccums.push_back(accum);
+        }
+    }
+
+    Accumulator getPrefixAccum(size_t n) {
+        size_t sample = n / indexStride;
+        Accumulator accum = prefixAccums[sample];
+        accum.addRange(items.data() + sample * indexStride, items.data() + n);
+        return accum;
+    }
+
     void checkSealed() {
         if (!sealed) throw negentropy::err("not sealed");
     }
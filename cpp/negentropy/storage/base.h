@@ -1,12 +1,31 @@
 #pragma once
 
 #include <functional>
+#include <vector>
+#include <algorithm>
+#include <optional>
 
 #include "negentropy/types.h"
 
 
 namespace negentropy {
 
+// Summary of one bucket of a range that is being split. firstItem and lastItem are only set if the bucket is non-empty.
+
+struct Bucket {
+    Fingerprint fingerprint;
+    Item firstItem;
+    Item lastItem;
+};
+
+// Returns the offset where bucket i starts when [begin, end) is divided into numBuckets buckets.
+// Sizes differ by at most one: the first (end - begin) % numBuckets buckets get an extra item.
+
+inline size_t bucketBoundary(size_t begin, size_t end, size_t numBuckets, size_t i) {
+    size_t numElems = end - begin;
+    return begin + i * (numElems / numBuckets) + std::min(i, numElems % numBuckets);
+}
+
 struct StorageBase {
     virtual uint64_t size() = 0;
 
@@ -17,6 +36,35 @@ struct StorageBase {
     virtual size_t findLowerBound(size_t begin, size_t end, const Bound &value) = 0;
 
     virtual Fingerprint fingerprint(size_t begin, size_t end) = 0;
+
+    // Changes whenever the contents of the storage change, so that derived data (such as cached
+    // fingerprints) can be invalidated. Storage that doesn't track changes returns nullopt, and can't
+    // be cached. Storage that never changes can return any constant.
+
+    virtual std::optional<uint64_t> version() {
+        return std::nullopt;
+    }
+
+    // Splits [begin, end) into numBuckets buckets, as described in bucketBoundary(). Implementations
+    // should override this if they can summarise all the buckets more cheaply than one at a time.
+
+    virtual std::vector<Bucket> fingerprintBuckets(size_t begin, size_t end, size_t numBuckets) {
+        std::vector<Bucket> out(numBuckets);
+
+        for (size_t i = 0; i < numBuckets; i++) {
+            size_t bucketBegin = bucketBoundary(begin, end, numBuckets, i);
+            size_t bucketEnd = bucketBoundary(begin, end, numBuckets, i + 1);
+
+            out[i].fingerprint = fingerprint(bucketBegin, bucketEnd);
+
+            if (bucketBegin != bucketEnd) {
+                out[i].firstItem = getItem(bucketBegin);
+                out[i].lastItem = getItem(bucketEnd - 1);
+            }
+        }
+
+        return out;
+    }
 };
 
 }
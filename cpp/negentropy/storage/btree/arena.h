@@ -0,0 +1,174 @@
+#pragma once
+
+#include <stdlib.h>
+
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include <new>
+
+#include "negentropy/storage/btree/core.h"
+
+
+namespace negentropy { namespace storage { namespace btree {
+
+
+// Holds Nodes in page-aligned slabs, located by nodeId through an open-addressing hash index
+// (linear probing). Node addresses are stable until the node is erased or the arena is cleared,
+// and clearing keeps the slabs allocated so that they can be reused. Nodes stored elsewhere can
+// also be indexed, without being owned by the arena.
+
+template<typename NodeType>
+struct BasicNodeArena {
+    using Node = NodeType;
+
+    static constexpr size_t NODES_PER_SLAB = 64;
+    static constexpr size_t PAGE_SIZE = 4096;
+
+    struct Slot {
+        uint64_t nodeId;
+        Node *node;
+        bool owned;
+    };
+
+    // Returns nullptr if nodeId isn't present
+    Node *find(uint64_t nodeId) {
+        if (index.empty()) return nullptr;
+
+        for (size_t i = hash(nodeId);; i = (i + 1) & mask()) {
+            if (index[i].nodeId == nodeId) return index[i].node;
+            if (index[i].nodeId == EMPTY) return nullptr;
+        }
+    }
+
+    // nodeId must not already be present. The returned Node is zeroed.
+    Node *insert(uint64_t nodeId) {
+        Node *node = allocNode();
+        new (node) Node();
+        addToIndex({ nodeId, node, true });
+        return node;
+    }
+
+    // Indexes a Node that the arena doesn't own. nodeId must not already be present.
+    void insertExternal(uint64_t nodeId, Node *node) {
+        addToIndex({ nodeId, node, false });
+    }
+
+    void erase(uint64_t nodeId) {
+        if (index.empty()) return;
+
+        for (size_t i = hash(nodeId);; i = (i + 1) & mask()) {
+            if (index[i].nodeId == nodeId) {
+                if (index[i].owned) freeNodes.push_back(index[i].node);
+                index[i].nodeId = TOMBSTONE;
+                numLive--;
+                return;
+            }
+            if (index[i].nodeId == EMPTY) return;
+        }
+    }
+
+    size_t size() const {
+        return numLive;
+    }
+
+    // All present nodes, sorted by nodeId
+    std::vector<Slot> sorted() const {
+        std::vector<Slot> out;
+        out.reserve(numLive);
+
+        for (const auto &s : index) {
+            if (s.nodeId != EMPTY && s.nodeId != TOMBSTONE) out.push_back(s);
+        }
+
+        std::sort(out.begin(), out.end(), [](const Slot &a, const Slot &b){ return a.nodeId < b.nodeId; });
+        return out;
+    }
+
+    void clear() {
+        std::fill(index.begin(), index.end(), Slot{ EMPTY, nullptr, false });
+        numUsed = numLive = 0;
+        freeNodes.clear();
+        nextFresh = 0;
+    }
+
+  private:
+    static constexpr uint64_t EMPTY = 0; // node 0 is metadata, so never stored here
+    static constexpr uint64_t TOMBSTONE = ~0ULL;
+
+    struct SlabDeleter {
+        void operator()(Node *p) const {
+            ::free(p);
+        }
+    };
+
+    std::vector<std::unique_ptr<Node, SlabDeleter>> slabs;
+    size_t nextFresh = 0; // slabs are filled in order, then freed nodes are reused
+    std::vector<Node *> freeNodes;
+
+    std::vector<Slot> index; // size is a power of 2
+    size_t numUsed = 0; // live + tombstones
+    size_t numLive = 0;
+
+    size_t mask() const {
+        return index.size() - 1;
+    }
+
+    size_t hash(uint64_t nodeId) const {
+        return (nodeId * 0x9E3779B97F4A7C15ULL >> 32) & mask();
+    }
+
+    void addToIndex(const Slot &slot) {
+        if ((numUsed + 1) * 2 > index.size()) rehash(std::max(size_t(64), numLive * 4));
+
+        size_t i = hash(slot.nodeId);
+        while (index[i].nodeId != EMPTY && index[i].nodeId != TOMBSTONE) i = (i + 1) & mask();
+
+        if (index[i].nodeId == EMPTY) numUsed++;
+        index[i] = slot;
+        numLive++;
+    }
+
+    Node *allocNode() {
+        if (freeNodes.size()) {
+            Node *node = freeNodes.back();
+            freeNodes.pop_back();
+            return node;
+        }
+
+        size_t slab = nextFresh / NODES_PER_SLAB;
+
+        if (slab == slabs.size()) {
+            size_t bytes = (NODES_PER_SLAB * sizeof(Node) + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+            void *p = ::aligned_alloc(PAGE_SIZE, bytes);
+            if (!p) throw std::bad_alloc();
+            slabs.emplace_back(static_cast<Node *>(p));
+        }
+
+        return slabs[slab].get() + (nextFresh++ % NODES_PER_SLAB);
+    }
+
+    void rehash(size_t minSize) {
+        size_t newSize = 64;
+        while (newSize < minSize) newSize *= 2;
+
+        std::vector<Slot> old;
+        old.swap(index);
+        index.assign(newSize, Slot{ EMPTY, nullptr, false });
+        numUsed = 0;
+
+        for (const auto &s : old) {
+            if (s.nodeId == EMPTY || s.nodeId == TOMBSTONE) continue;
+
+            size_t i = hash(s.nodeId);
+            while (index[i].nodeId != EMPTY) i = (i + 1) & mask();
+            index[i] = s;
+            numUsed++;
+        }
+    }
+};
+
+using NodeArena = BasicNodeArena<Node>;
+
+
+}}}
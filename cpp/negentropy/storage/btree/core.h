@@ -17,7 +17,7 @@ be the nodeIds of the children leaves. The items in the keys of non-leaf nodes a
 in the corresponding child nodes.
 
 Except for the right-most nodes in the tree at each level (which includes the root node), all nodes
-contain at least MIN_ITEMS and at most MAX_ITEMS.
+contain at least MIN_ITEMS and at most MAX_ITEMS. These are set by the tree's Geometry.
 
 If a node falls below MIN_ITEMS, a neighbour node (which always has the same parent) is selected.
   * If between the two nodes there are REBALANCE_THRESHOLD or fewer total items, all items are
@@ -33,28 +33,38 @@ If a node goes above MAX_ITEMS then a new neighbour node is created.
 */
 
 
+// Trees with different geometries can be used in the same program, for example small nodes for
+// in-memory trees and page-sized nodes for LMDB.
+
+template<size_t MinItems, size_t RebalanceThreshold, size_t MaxItems>
+struct Geometry {
+    static constexpr size_t MIN_ITEMS = MinItems;
+    static constexpr size_t REBALANCE_THRESHOLD = RebalanceThreshold;
+    static constexpr size_t MAX_ITEMS = MaxItems;
+
+    static_assert(MIN_ITEMS < REBALANCE_THRESHOLD);
+    static_assert(REBALANCE_THRESHOLD < MAX_ITEMS);
+    static_assert(MAX_ITEMS / 2 > MIN_ITEMS);
+    static_assert(MIN_ITEMS % 2 == 0 && REBALANCE_THRESHOLD % 2 == 0 && MAX_ITEMS % 2 == 0);
+};
+
 #ifdef NE_FUZZ_TEST
 
 // Fuzz test mode: Causes a large amount of tree structure changes like splitting, moving, and rebalancing
 
-const size_t MIN_ITEMS = 2;
-const size_t REBALANCE_THRESHOLD = 4;
-const size_t MAX_ITEMS = 6;
+using DefaultGeometry = Geometry<2, 4, 6>;
 
 #else
 
 // Production mode: Nodes fit into 4k pages, and oscillating insert/erase will not cause tree structure changes
 
-const size_t MIN_ITEMS = 30;
-const size_t REBALANCE_THRESHOLD = 60;
-const size_t MAX_ITEMS = 80;
+using DefaultGeometry = Geometry<30, 60, 80>;
 
 #endif
 
-static_assert(MIN_ITEMS < REBALANCE_THRESHOLD);
-static_assert(REBALANCE_THRESHOLD < MAX_ITEMS);
-static_assert(MAX_ITEMS / 2 > MIN_ITEMS);
-static_assert(MIN_ITEMS % 2 == 0 && REBALANCE_THRESHOLD % 2 == 0 && MAX_ITEMS % 2 == 0);
+const size_t MIN_ITEMS = DefaultGeometry::MIN_ITEMS;
+const size_t REBALANCE_THRESHOLD = DefaultGeometry::REBALANCE_THRESHOLD;
+const size_t MAX_ITEMS = DefaultGeometry::MAX_ITEMS;
 
 
 struct Key {
@@ -71,7 +81,8 @@ inline bool operator<(const Key &a, const Key &b) {
     return a.item < b.item;
 };
 
-struct Node {
+template<typename G>
+struct BasicNode {
     uint64_t numItems; // Number of items in this Node
     uint64_t accumCount; // Total number of items in or under this Node
     uint64_t nextSibling; // Pointer to next node in this level
@@ -79,10 +90,10 @@ struct Node {
 
     Accumulator accum;
 
-    Key items[MAX_ITEMS + 1];
+    Key items[G::MAX_ITEMS + 1];
 
 
-    Node() {
+    BasicNode() {
         memset((void*)this, '\0', sizeof(*this));
     }
 
@@ -91,8 +102,34 @@ struct Node {
     }
 };
 
-struct NodePtr {
-    Node *p;
+// Returns the number of keys that are less than item (or less than or equal to item, if inclusive).
+// Timestamps usually decide comparisons, so a branch-free binary search is done on timestamps alone,
+// followed by a linear scan through any keys that share item's timestamp.
+
+inline size_t countKeysBefore(const Key *keys, size_t n, const Item &item, bool inclusive) {
+    const Key *base = keys;
+    size_t len = n;
+
+    while (len > 1) {
+        size_t half = len / 2;
+        base = base[half - 1].item.timestamp < item.timestamp ? base + half : base;
+        len -= half;
+    }
+
+    size_t i = (base - keys) + (len == 1 && base->item.timestamp < item.timestamp);
+
+    while (i < n && keys[i].item.timestamp == item.timestamp) {
+        int cmp = memcmp(keys[i].item.id, item.id, ID_SIZE);
+        if (cmp > 0 || (cmp == 0 && !inclusive)) break;
+        i++;
+    }
+
+    return i;
+}
+
+template<typename G>
+struct BasicNodePtr {
+    BasicNode<G> *p;
     uint64_t nodeId;
 
 
@@ -100,31 +137,62 @@ struct NodePtr {
         return p != nullptr;
     }
 
-    Node &get() const {
+    BasicNode<G> &get() const {
         return *p;
     }
 };
 
-struct Breadcrumb {
+using Node = BasicNode<DefaultGeometry>;
+using NodePtr = BasicNodePtr<DefaultGeometry>;
+
+template<typename G>
+struct BasicBreadcrumb {
     size_t index;
-    NodePtr nodePtr;
+    BasicNodePtr<G> nodePtr;
 };
 
+using Breadcrumb = BasicBreadcrumb<DefaultGeometry>;
+
 
+// Node storage is provided by Derived (CRTP), which must implement the methods below. They are
+// called without virtual dispatch, so node access can be inlined into the tree algorithms.
+
+template<typename Derived, typename G = DefaultGeometry>
 struct BTreeCore : StorageBase {
+    using NodeGeometry = G;
+    using Node = BasicNode<G>;
+    using NodePtr = BasicNodePtr<G>;
+    using Breadcrumb = BasicBreadcrumb<G>;
+
+    static constexpr size_t MIN_ITEMS = G::MIN_ITEMS;
+    static constexpr size_t REBALANCE_THRESHOLD = G::REBALANCE_THRESHOLD;
+    static constexpr size_t MAX_ITEMS = G::MAX_ITEMS;
+
     //// Node Storage
 
-    virtual const NodePtr getNodeRead(uint64_t nodeId) = 0;
+    const NodePtr getNodeRead(uint64_t nodeId) {
+        return derived().getNodeRead(nodeId);
+    }
 
-    virtual NodePtr getNodeWrite(uint64_t nodeId) = 0;
+    NodePtr getNodeWrite(uint64_t nodeId) {
+        return derived().getNodeWrite(nodeId);
+    }
 
-    virtual NodePtr makeNode() = 0;
+    NodePtr makeNode() {
+        return derived().makeNode();
+    }
 
-    virtual void deleteNode(uint64_t nodeId) = 0;
+    void deleteNode(uint64_t nodeId) {
+        derived().deleteNode(nodeId);
+    }
 
-    virtual uint64_t getRootNodeId() = 0;
+    uint64_t getRootNodeId() {
+        return derived().getRootNodeId();
+    }
 
-    virtual void setRootNodeId(uint64_t newRootNodeId) = 0;
+    void setRootNodeId(uint64_t newRootNodeId) {
+        derived().setRootNodeId(newRootNodeId);
+    }
 
 
     //// Search
@@ -132,21 +200,15 @@ struct BTreeCore : StorageBase {
     std::vector<Breadcrumb> searchItem(uint64_t rootNodeId, const Item &newItem, bool &found) {
         found = false;
         std::vector<Breadcrumb> breadcrumbs;
+        breadcrumbs.reserve(8);
 
         auto foundNode = getNodeRead(rootNodeId);
 
         while (foundNode.nodeId) {
             const auto &node = foundNode.get();
-            size_t index = node.numItems - 1;
 
-            if (node.numItems > 1) {
-                for (size_t i = 1; i < node.numItems + 1; i++) {
-                    if (i == node.numItems + 1 || newItem < node.items[i].item) {
-                        index = i - 1;
-                        break;
-                    }
-                }
-            }
+            // Index of the last key <= newItem, or 0 if newItem is before all keys
+            size_t index = countKeysBefore(node.items + 1, node.numItems - 1, newItem, true);
 
             if (!found && (newItem == node.items[index].item)) found = true;
 
@@ -170,6 +232,8 @@ struct BTreeCore : StorageBase {
         auto rootNodeId = getRootNodeId();
 
         if (!rootNodeId) {
+            currVersion++;
+
             auto newNodePtr = makeNode();
             auto &newNode = newNodePtr.get();
 
@@ -191,6 +255,8 @@ struct BTreeCore : StorageBase {
 
         if (found) return false; // already inserted
 
+        currVersion++;
+
 
         // Follow breadcrumbs back to root
 
@@ -295,6 +361,75 @@ struct BTreeCore : StorageBase {
 
 
 
+    /// Bulk load
+
+    // Builds the tree bottom-up from a range of items that must already be sorted and unique.
+    // Nodes are packed to MAX_ITEMS, the same as when items are appended one at a time.
+
+    template<typename It>
+    void bulkLoad(It begin, It end) {
+        if (getRootNodeId()) throw err("bulkLoad requires an empty tree");
+        if (begin == end) return;
+
+        if (std::adjacent_find(begin, end, [](const Item &a, const Item &b){ return !(a < b); }) != end) {
+            throw err("bulkLoad items not sorted and unique");
+        }
+
+        currVersion++;
+
+        auto keys = bulkLoadLevel(begin, end, [](const Item &item){ return Key{ item, 0 }; });
+
+        while (keys.size() > 1) {
+            keys = bulkLoadLevel(keys.begin(), keys.end(), [](const Key &key){ return key; });
+        }
+
+        setRootNodeId(keys[0].nodeId);
+    }
+
+    template<typename It, typename ToKey>
+    std::vector<Key> bulkLoadLevel(It begin, It end, ToKey toKey) {
+        std::vector<Key> parentKeys;
+        NodePtr currPtr{nullptr, 0};
+
+        for (auto it = begin; it != end; ++it) {
+            Key key = toKey(*it);
+
+            if (!currPtr.exists() || currPtr.get().numItems == MAX_ITEMS) {
+                auto newPtr = makeNode();
+
+                if (currPtr.exists()) {
+                    computeAccum(currPtr.get());
+                    currPtr.get().nextSibling = newPtr.nodeId;
+                    newPtr.get().prevSibling = currPtr.nodeId;
+                }
+
+                currPtr = newPtr;
+                parentKeys.push_back({ key.item, currPtr.nodeId });
+            }
+
+            auto &node = currPtr.get();
+            node.items[node.numItems++] = key;
+        }
+
+        if (currPtr.exists()) computeAccum(currPtr.get());
+
+        return parentKeys;
+    }
+
+    void computeAccum(Node &node) {
+        node.accum.setToZero();
+        node.accumCount = 0;
+
+        if (node.items[0].nodeId == 0) {
+            node.accum.addRange(node.items, node.items + node.numItems, [](const Key &k){ return k.item.id; });
+            node.accumCount = node.numItems;
+        } else {
+            for (size_t i = 0; i < node.numItems; i++) addToAccum(node.items[i], node);
+        }
+    }
+
+
+
     /// Erase
 
     bool erase(uint64_t createdAt, std::string_view id) {
@@ -312,6 +447,8 @@ struct BTreeCore : StorageBase {
         auto breadcrumbs = searchItem(rootNodeId, oldItem, found);
         if (!found) return false;
 
+        currVersion++;
+
 
         // Remove from node
 
@@ -498,6 +635,153 @@ struct BTreeCore : StorageBase {
     }
 
 
+
+    /// Batch insert/erase
+
+    // Batches are sorted and then split into groups of items that belong in the same leaf. If a
+    // group can be applied to its leaf without splitting or rebalancing, the leaf is updated once,
+    // and each ancestor receives a single accumulator delta. Otherwise, items fall back to
+    // insertItem/eraseItem one at a time until the leaf can again absorb a group.
+
+    template<typename It>
+    size_t insertBatch(It begin, It end) {
+        auto batch = sortBatch(begin, end);
+
+        if (!getRootNodeId()) {
+            bulkLoad(batch.begin(), batch.end());
+            return batch.size();
+        }
+
+        size_t numInserted = 0;
+        size_t i = 0;
+
+        while (i < batch.size()) {
+            bool found;
+            auto breadcrumbs = searchItem(getRootNodeId(), batch[i], found);
+            const auto &leaf = breadcrumbs.back().nodePtr.get();
+
+            size_t room = MAX_ITEMS - leaf.numItems;
+            size_t groupEnd = findGroupEnd(leaf, batch, i);
+
+            if (room == 0) {
+                if (insertItem(batch[i])) numInserted++;
+                i++;
+                continue;
+            }
+
+            std::vector<Key> newKeys;
+
+            for (; i < groupEnd && newKeys.size() < room; i++) {
+                if (!leafContains(leaf, batch[i])) newKeys.push_back({ batch[i], 0 });
+            }
+
+            if (newKeys.empty()) continue;
+
+            auto &node = getNodeWrite(breadcrumbs.back().nodePtr.nodeId).get();
+
+            std::copy(newKeys.begin(), newKeys.end(), node.items + node.numItems);
+            std::inplace_merge(node.items, node.items + node.numItems, node.items + node.numItems + newKeys.size());
+            node.numItems += newKeys.size();
+
+            Accumulator delta;
+            delta.setToZero();
+            delta.addRange(newKeys.data(), newKeys.data() + newKeys.size(), [](const Key &k){ return k.item.id; });
+
+            applyDelta(breadcrumbs, delta, newKeys.size(), true);
+            numInserted += newKeys.size();
+        }
+
+        return numInserted;
+    }
+
+    template<typename It>
+    size_t eraseBatch(It begin, It end) {
+        auto batch = sortBatch(begin, end);
+
+        size_t numErased = 0;
+        size_t i = 0;
+
+        while (i < batch.size() && getRootNodeId()) {
+            bool found;
+            auto breadcrumbs = searchItem(getRootNodeId(), batch[i], found);
+            const auto &leaf = breadcrumbs.back().nodePtr.get();
+
+            size_t minItems = breadcrumbs.size() == 1 ? 1 : MIN_ITEMS;
+            size_t removable = leaf.numItems > minItems ? leaf.numItems - minItems : 0;
+            size_t groupEnd = findGroupEnd(leaf, batch, i);
+
+            if (removable == 0) {
+                if (eraseItem(batch[i])) numErased++;
+                i++;
+                continue;
+            }
+
+            std::vector<Key> oldKeys;
+
+            for (; i < groupEnd && oldKeys.size() < removable; i++) {
+                if (leafContains(leaf, batch[i])) oldKeys.push_back({ batch[i], 0 });
+            }
+
+            if (oldKeys.empty()) continue;
+
+            auto &node = getNodeWrite(breadcrumbs.back().nodePtr.nodeId).get();
+
+            auto newEnd = std::remove_if(node.items, node.items + node.numItems, [&](const Key &k){
+                return std::binary_search(oldKeys.begin(), oldKeys.end(), k);
+            });
+            node.numItems = newEnd - node.items;
+            for (size_t j = node.numItems; j < MAX_ITEMS + 1; j++) node.items[j].setToZero();
+
+            Accumulator delta;
+            delta.setToZero();
+            delta.addRange(oldKeys.data(), oldKeys.data() + oldKeys.size(), [](const Key &k){ return k.item.id; });
+
+            applyDelta(breadcrumbs, delta, oldKeys.size(), false);
+            numErased += oldKeys.size();
+        }
+
+        return numErased;
+    }
+
+    template<typename It>
+    static std::vector<Item> sortBatch(It begin, It end) {
+        std::vector<Item> batch(begin, end);
+        std::sort(batch.begin(), batch.end());
+        batch.erase(std::unique(batch.begin(), batch.end()), batch.end());
+        return batch;
+    }
+
+    // Items from batch[i] up to (but not including) the first item of the next leaf are routed to this leaf
+
+    size_t findGroupEnd(const Node &leaf, const std::vector<Item> &batch, size_t i) {
+        if (!leaf.nextSibling) return batch.size();
+        const auto &nextFirst = getNodeRead(leaf.nextSibling).get().items[0].item;
+        return std::lower_bound(batch.begin() + i, batch.end(), nextFirst) - batch.begin();
+    }
+
+    static bool leafContains(const Node &leaf, const Item &item) {
+        return std::binary_search(leaf.items, leaf.items + leaf.numItems, Key{ item, 0 });
+    }
+
+    void applyDelta(const std::vector<Breadcrumb> &breadcrumbs, const Accumulator &delta, uint64_t count, bool isAdd) {
+        currVersion++;
+
+        for (auto it = breadcrumbs.rbegin(); it != breadcrumbs.rend(); ++it) {
+            auto &node = getNodeWrite(it->nodePtr.nodeId).get();
+
+            if (isAdd) {
+                node.accum.add(delta);
+                node.accumCount += count;
+            } else {
+                node.accum.sub(delta);
+                node.accumCount -= count;
+            }
+
+            refreshIndex(node, it->index);
+        }
+    }
+
+
     //// Compat with the vector interface
 
     void seal() {
@@ -528,7 +812,16 @@ struct BTreeCore : StorageBase {
         }
     }
 
-    void traverseToOffset(size_t index, const std::function<void(Node &node, size_t index)> &cb, std::function<void(Node &)> customAccum = nullptr) {
+    // Calls cb with the leaf containing offset index, and the position within it. customAccum is
+    // called with each child node that is skipped over on the way down.
+
+    template<typename F>
+    void traverseToOffset(size_t index, F &&cb) {
+        traverseToOffset(index, cb, [](Node &){});
+    }
+
+    template<typename F, typename A>
+    void traverseToOffset(size_t index, F &&cb, A &&customAccum) {
         auto rootNodePtr = getNodeRead(getRootNodeId());
         if (!rootNodePtr.exists()) return;
         auto &rootNode = rootNodePtr.get();
@@ -537,24 +830,38 @@ struct BTreeCore : StorageBase {
         return traverseToOffsetAux(index, rootNode, cb, customAccum);
     }
 
-    void traverseToOffsetAux(size_t index, Node &node, const std::function<void(Node &node, size_t index)> &cb, std::function<void(Node &)> customAccum) {
-        if (node.numItems == node.accumCount) {
-            cb(node, index);
-            return;
-        }
+    template<typename F, typename A>
+    void traverseToOffsetAux(size_t index, Node &node, F &cb, A &customAccum) {
+        Node *currNode = &node;
+
+        while (currNode->numItems != currNode->accumCount) {
+            Node *nextNode = nullptr;
 
-        for (size_t i = 0; i < node.numItems; i++) {
-            auto &child = getNodeRead(node.items[i].nodeId).get();
-            if (index < child.accumCount) return traverseToOffsetAux(index, child, cb, customAccum);
-            index -= child.accumCount;
-            if (customAccum) customAccum(child);
+            for (size_t i = 0; i < currNode->numItems; i++) {
+                auto &child = getNodeRead(currNode->items[i].nodeId).get();
+                if (index < child.accumCount) {
+                    nextNode = &child;
+                    break;
+                }
+                index -= child.accumCount;
+                customAccum(child);
+            }
+
+            if (!nextNode) return;
+            currNode = nextNode;
         }
+
+        cb(*currNode, index);
     }
 
 
 
     //// Interface
 
+    std::optional<uint64_t> version() {
+        return currVersion;
+    }
+
     uint64_t size() {
         auto rootNodePtr = getNodeRead(getRootNodeId());
         if (!rootNodePtr.exists()) return 0;
@@ -565,7 +872,7 @@ struct BTreeCore : StorageBase {
     const Item &getItem(size_t index) {
         if (index >= size()) throw err("out of range");
 
-        Item *out;
+        Item *out = nullptr;
         traverseToOffset(index, [&](Node &node, size_t index){
             out = &node.items[index].item;
         });
@@ -573,6 +880,13 @@ struct BTreeCore : StorageBase {
     }
 
     void iterate(size_t begin, size_t end, std::function<bool(const Item &, size_t)> cb) {
+        forEach(begin, end, cb);
+    }
+
+    // Same as iterate(), but cb is not type-erased so it can be inlined
+
+    template<typename F>
+    void forEach(size_t begin, size_t end, F &&cb) {
         checkBounds(begin, end);
 
         size_t num = end - begin;
@@ -605,16 +919,21 @@ struct BTreeCore : StorageBase {
 
         Node &node = nodePtr.get();
 
-        for (size_t i = 1; i < node.numItems; i++) {
-            if (value.item <= node.items[i].item) {
-                return findLowerBoundAux(value, getNodeRead(node.items[i - 1].nodeId), numToLeft);
-            } else {
-                if (node.items[i - 1].nodeId) numToLeft += getNodeRead(node.items[i - 1].nodeId).get().accumCount;
-                else numToLeft++;
-            }
+        // Descend into the child before the first key >= value (or the last child, if none)
+        size_t index = countKeysBefore(node.items + 1, node.numItems - 1, value.item, false);
+
+        if (node.items[0].nodeId == 0) {
+            numToLeft += index;
+        } else if (index <= node.numItems / 2) {
+            for (size_t i = 0; i < index; i++) numToLeft += getNodeRead(node.items[i].nodeId).get().accumCount;
+        } else {
+            // Fewer children to the right: Count those and subtract from this node's total instead
+            uint64_t numToRight = 0;
+            for (size_t i = index; i < node.numItems; i++) numToRight += getNodeRead(node.items[i].nodeId).get().accumCount;
+            numToLeft += node.accumCount - numToRight;
         }
 
-        return findLowerBoundAux(value, getNodeRead(node.items[node.numItems - 1].nodeId), numToLeft);
+        return findLowerBoundAux(value, getNodeRead(node.items[index].nodeId), numToLeft);
     }
 
     Fingerprint fingerprint(size_t begin, size_t end) {
@@ -625,7 +944,7 @@ struct BTreeCore : StorageBase {
             accum.setToZero();
 
             traverseToOffset(index, [&](Node &node, size_t index){
-                for (size_t i = 0; i < index; i++) accum.add(node.items[i].item);
+                accum.addRange(node.items, node.items + index, [](const Key &k){ return k.item.id; });
             }, [&](Node &node){
                 accum.add(node.accum);
             });
@@ -636,13 +955,105 @@ struct BTreeCore : StorageBase {
         auto accum1 = getAccumLeftOf(begin);
         auto accum2 = getAccumLeftOf(end);
 
-        accum1.negate();
-        accum2.add(accum1);
+        accum2.sub(accum1);
 
         return accum2.getFingerprint(end - begin);
     }
 
+    std::vector<Bucket> fingerprintBuckets(size_t begin, size_t end, size_t numBuckets) {
+        checkBounds(begin, end);
+
+        // Collect every offset whose prefix accumulator and/or item is needed: bucket boundaries,
+        // and the last item of each bucket. All of these are found in a single walk of the tree.
+
+        BucketWalk walk;
+
+        for (size_t i = 0; i <= numBuckets; i++) {
+            size_t boundary = bucketBoundary(begin, end, numBuckets, i);
+            if (i > 0 && boundary > begin) walk.offsets.push_back(boundary - 1);
+            walk.offsets.push_back(boundary);
+        }
+
+        std::sort(walk.offsets.begin(), walk.offsets.end());
+        walk.offsets.erase(std::unique(walk.offsets.begin(), walk.offsets.end()), walk.offsets.end());
+
+        walk.accums.resize(walk.offsets.size());
+        walk.items.resize(walk.offsets.size());
+        walk.accum.setToZero();
+
+        auto rootNodePtr = getNodeRead(getRootNodeId());
+        if (rootNodePtr.exists()) walkToOffsets(rootNodePtr.get(), 0, walk);
+
+        for (; walk.next < walk.offsets.size(); walk.next++) walk.accums[walk.next] = walk.accum; // offsets at end of tree
+
+        auto lookup = [&](size_t offset){
+            return std::lower_bound(walk.offsets.begin(), walk.offsets.end(), offset) - walk.offsets.begin();
+        };
+
+        std::vector<Bucket> out(numBuckets);
+
+        for (size_t i = 0; i < numBuckets; i++) {
+            size_t bucketBegin = bucketBoundary(begin, end, numBuckets, i);
+            size_t bucketEnd = bucketBoundary(begin, end, numBuckets, i + 1);
+            size_t beginIndex = lookup(bucketBegin);
+            size_t endIndex = lookup(bucketEnd);
+
+            Accumulator accum = walk.accums[endIndex];
+            accum.sub(walk.accums[beginIndex]);
+            out[i].fingerprint = accum.getFingerprint(bucketEnd - bucketBegin);
+
+            if (bucketBegin != bucketEnd) {
+                out[i].firstItem = walk.items[beginIndex];
+                out[i].lastItem = walk.items[lookup(bucketEnd - 1)];
+            }
+        }
+
+        return out;
+    }
+
+    struct BucketWalk {
+        std::vector<size_t> offsets; // sorted
+        std::vector<Accumulator> accums; // sum of all items before each offset
+        std::vector<Item> items; // item at each offset
+        size_t next = 0; // index of next offset to be reached
+        Accumulator accum; // sum of all items before current position
+    };
+
+    void walkToOffsets(const Node &node, size_t nodeOffset, BucketWalk &walk) {
+        if (node.items[0].nodeId == 0) {
+            size_t curr = 0;
+
+            while (walk.next < walk.offsets.size() && walk.offsets[walk.next] < nodeOffset + node.numItems) {
+                size_t index = walk.offsets[walk.next] - nodeOffset;
+                walk.accum.addRange(node.items + curr, node.items + index, [](const Key &k){ return k.item.id; });
+                curr = index;
+
+                walk.accums[walk.next] = walk.accum;
+                walk.items[walk.next] = node.items[index].item;
+                walk.next++;
+            }
+
+            walk.accum.addRange(node.items + curr, node.items + node.numItems, [](const Key &k){ return k.item.id; });
+            return;
+        }
+
+        for (size_t i = 0; i < node.numItems && walk.next < walk.offsets.size(); i++) {
+            const auto &child = getNodeRead(node.items[i].nodeId).get();
+
+            if (walk.offsets[walk.next] < nodeOffset + child.accumCount) walkToOffsets(child, nodeOffset, walk);
+            else walk.accum.add(child.accum);
+
+            nodeOffset += child.accumCount;
+        }
+    }
+
   private:
+    uint64_t currVersion = 0;
+
+    Derived &derived() {
+        return static_cast<Derived &>(*this);
+    }
+
     void checkBounds(size_t begin, size_t end) {
         if (begin > end || end > size()) throw negentropy::err("bad range");
     }
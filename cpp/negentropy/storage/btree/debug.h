@@ -16,7 +16,8 @@ namespace negentropy { namespace storage { namespace btree {
 using err = std::runtime_error;
 
 
-inline void dump(BTreeCore &btree, uint64_t nodeId, int depth) {
+template<typename Derived, typename G>
+inline void dump(BTreeCore<Derived, G> &btree, uint64_t nodeId, int depth) {
     if (nodeId == 0) {
         if (depth == 0) std::cout << "EMPTY TREE" << std::endl;
         return;
@@ -34,7 +35,8 @@ inline void dump(BTreeCore &btree, uint64_t nodeId, int depth) {
     }
 }
 
-inline void dump(BTreeCore &btree) {
+template<typename Derived, typename G>
+inline void dump(BTreeCore<Derived, G> &btree) {
     dump(btree, btree.getRootNodeId(), 0);
 }
 
@@ -45,7 +47,8 @@ struct VerifyContext {
     std::vector<uint64_t> leafNodeIds;
 };
 
-inline void verify(BTreeCore &btree, uint64_t nodeId, uint64_t depth, VerifyContext &ctx, Accumulator *accumOut = nullptr, uint64_t *accumCountOut = nullptr) {
+template<typename Derived, typename G>
+inline void verify(BTreeCore<Derived, G> &btree, uint64_t nodeId, uint64_t depth, VerifyContext &ctx, Accumulator *accumOut = nullptr, uint64_t *accumCountOut = nullptr) {
     if (nodeId == 0) return;
 
     if (ctx.allNodeIds.contains(nodeId)) throw err("verify: saw node id again");
@@ -55,8 +58,8 @@ inline void verify(BTreeCore &btree, uint64_t nodeId, uint64_t depth, VerifyCont
     auto &node = nodePtr.get();
 
     if (node.numItems == 0) throw err("verify: empty node");
-    if (node.nextSibling && node.numItems < MIN_ITEMS) throw err("verify: too few items in node");
-    if (node.numItems > MAX_ITEMS) throw err("verify: too many items");
+    if (node.nextSibling && node.numItems < G::MIN_ITEMS) throw err("verify: too few items in node");
+    if (node.numItems > G::MAX_ITEMS) throw err("verify: too many items");
 
     if (node.items[0].nodeId == 0) {
         if (ctx.leafDepth) {
@@ -93,7 +96,7 @@ inline void verify(BTreeCore &btree, uint64_t nodeId, uint64_t depth, VerifyCont
         }
     }
 
-    for (size_t i = node.numItems; i < MAX_ITEMS + 1; i++) {
+    for (size_t i = node.numItems; i < G::MAX_ITEMS + 1; i++) {
         for (size_t j = 0; j < sizeof(Key); j++) if (((char*)&node.items[i])[j] != '\0') throw err("verify: memory not zeroed out");
     }
 
@@ -104,7 +107,8 @@ inline void verify(BTreeCore &btree, uint64_t nodeId, uint64_t depth, VerifyCont
     if (accumCountOut) *accumCountOut += accumCount;
 }
 
-inline void verify(BTreeCore &btree, bool isLMDB) {
+template<typename Derived, typename G>
+inline void verify(BTreeCore<Derived, G> &btree, bool isLMDB) {
     VerifyContext ctx;
     Accumulator accum;
     accum.setToZero();
@@ -140,10 +144,15 @@ inline void verify(BTreeCore &btree, bool isLMDB) {
 
     // Check for leaks
 
-    if (isLMDB) {
+    auto &derived = static_cast<Derived&>(btree);
+    constexpr bool derivedIsLMDB = std::is_same_v<Derived, BasicBTreeLMDB<G>>;
+    constexpr bool derivedIsMem = std::is_same_v<Derived, BasicBTreeMem<G>>;
+    if (isLMDB != derivedIsLMDB) throw err("verify: unexpected storage type");
+
+    if constexpr (derivedIsLMDB) {
         static_assert(std::endian::native == std::endian::little); // FIXME
 
-        auto &btreeLMDB = dynamic_cast<BTreeLMDB&>(btree);
+        auto &btreeLMDB = derived;
         btreeLMDB.flush();
 
         std::string_view key, val;
@@ -167,8 +176,8 @@ inline void verify(BTreeCore &btree, bool isLMDB) {
             tpKey += lmdb::to_sv(k);
             if (!btreeLMDB.dbi.get(btreeLMDB.txn, tpKey, val)) throw err("verify: dangling node");
         }
-    } else {
-        auto &btreeMem = dynamic_cast<BTreeMem&>(btree);
+    } else if constexpr (derivedIsMem) {
+        auto &btreeMem = derived;
 
         // Leaks
 
@@ -4,6 +4,10 @@
 
 #include <openssl/sha.h>
 
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
 
 namespace negentropy {
 
@@ -83,6 +87,29 @@ struct Fingerprint {
 struct Accumulator {
     uint8_t buf[ID_SIZE];
 
+    // The accumulator is a 256-bit little-endian integer, processed as 4 64-bit limbs
+
+    using Limb = unsigned long long;
+    using Limbs = Limb[4];
+
+    static void loadLimbs(Limbs &out, const uint8_t *p) {
+        memcpy(out, p, sizeof(Limbs));
+
+        if constexpr (std::endian::native == std::endian::big) {
+            for (size_t i = 0; i < 4; i++) out[i] = __builtin_bswap64(out[i]);
+        } else {
+            static_assert(std::endian::native == std::endian::little);
+        }
+    }
+
+    static void storeLimbs(uint8_t *p, Limbs &in) {
+        if constexpr (std::endian::native == std::endian::big) {
+            for (size_t i = 0; i < 4; i++) in[i] = __builtin_bswap64(in[i]);
+        }
+
+        memcpy(p, in, sizeof(Limbs));
+    }
+
     void setToZero() {
         memset(buf, '\0', sizeof(buf));
     }
@@ -95,44 +122,62 @@ struct Accumulator {
         add(acc.buf);
     }
 
-    void add(const uint8_t *otherBuf) {
-        uint64_t currCarry = 0, nextCarry = 0;
-        uint64_t *p = reinterpret_cast<uint64_t*>(buf);
-        const uint64_t *po = reinterpret_cast<const uint64_t*>(otherBuf);
+    static void addLimbs(Limbs &a, const Limbs &b) {
+#if defined(__x86_64__)
+        unsigned char carry = 0;
+        for (size_t i = 0; i < 4; i++) carry = _addcarry_u64(carry, a[i], b[i], &a[i]);
+#else
+        Limb carry = 0;
+        for (size_t i = 0; i < 4; i++) {
+            Limb next;
+            Limb c1 = __builtin_add_overflow(a[i], b[i], &next);
+            Limb c2 = __builtin_add_overflow(next, carry, &next);
+            a[i] = next;
+            carry = c1 | c2;
+        }
+#endif
+    }
 
-        auto byteswap = [](uint64_t &n) {
-            uint8_t *first = reinterpret_cast<uint8_t*>(&n);
-            uint8_t *last = first + 8;
-            std::reverse(first, last);
-        };
+    void add(const uint8_t *otherBuf) {
+        Limbs a, b;
+        loadLimbs(a, buf);
+        loadLimbs(b, otherBuf);
+        addLimbs(a, b);
+        storeLimbs(buf, a);
+    }
 
-        for (size_t i = 0; i < 4; i++) {
-            uint64_t orig = p[i];
-            uint64_t otherV = po[i];
-
-            if constexpr (std::endian::native == std::endian::big) {
-                byteswap(orig);
-                byteswap(otherV);
-            } else {
-                static_assert(std::endian::native == std::endian::little);
-            }
+    void addRange(const Item *begin, const Item *end) {
+        addRange(begin, end, [](const Item &item){ return item.id; });
+    }
 
-            uint64_t next = orig;
+    // Adds the IDs of a contiguous span of elements. getId maps an element to its ID bytes.
+    // Each limb is summed independently and the carries out of it are counted rather than
+    // propagated, so the per-element work has no dependency chain between limbs. The carry
+    // counts are folded into the next limb up once, at the end of the span.
 
-            next += currCarry;
-            if (next < orig) nextCarry = 1;
+    template<typename T, typename GetId>
+    void addRange(const T *begin, const T *end, GetId getId) {
+        Limbs sums = { 0, 0, 0, 0 };
+        Limbs carries = { 0, 0, 0, 0 };
 
-            next += otherV;
-            if (next < otherV) nextCarry = 1;
+        for (const T *p = begin; p != end; ++p) {
+            Limbs v;
+            loadLimbs(v, getId(*p));
 
-            if constexpr (std::endian::native == std::endian::big) {
-                byteswap(next);
+            for (size_t i = 0; i < 4; i++) {
+                sums[i] += v[i];
+                carries[i] += sums[i] < v[i];
             }
-
-            p[i] = next;
-            currCarry = nextCarry;
-            nextCarry = 0;
         }
+
+        Limbs a;
+        loadLimbs(a, buf);
+        addLimbs(a, sums);
+
+        Limbs shiftedCarries = { 0, carries[0], carries[1], carries[2] }; // carries out of top limb are discarded (mod 2^256)
+        addLimbs(a, shiftedCarries);
+
+        storeLimbs(buf, a);
     }
 
     void negate() {
@@ -155,10 +200,27 @@ struct Accumulator {
     }
 
     void sub(const uint8_t *otherBuf) {
-        Accumulator neg;
-        memcpy(neg.buf, otherBuf, sizeof(buf));
-        neg.negate();
-        add(neg);
+        // Subtract-with-borrow: equivalent to adding the two's complement of otherBuf
+
+        Limbs a, b;
+        loadLimbs(a, buf);
+        loadLimbs(b, otherBuf);
+
+#if defined(__x86_64__)
+        unsigned char borrow = 0;
+        for (size_t i = 0; i < 4; i++) borrow = _subborrow_u64(borrow, a[i], b[i], &a[i]);
+#else
+        Limb borrow = 0;
+        for (size_t i = 0; i < 4; i++) {
+            Limb next;
+            Limb b1 = __builtin_sub_overflow(a[i], b[i], &next);
+            Limb b2 = __builtin_sub_overflow(next, borrow, &next);
+            a[i] = next;
+            borrow = b1 | b2;
+        }
+#endif
+
+        storeLimbs(buf, a);
     }
 
     std::string_view sv() const {
@@ -166,12 +228,15 @@ struct Accumulator {
     }
 
     Fingerprint getFingerprint(uint64_t n) {
-        std::string input;
-        input += sv();
-        input += encodeVarInt(n);
+        char varIntBuf[MAX_VARINT_SIZE];
+        auto encodedN = encodeVarInt(n, varIntBuf);
+
+        unsigned char input[ID_SIZE + MAX_VARINT_SIZE];
+        memcpy(input, buf, ID_SIZE);
+        memcpy(input + ID_SIZE, encodedN.data(), encodedN.size());
 
         unsigned char hash[SHA256_DIGEST_LENGTH];
-        SHA256(reinterpret_cast<unsigned char*>(input.data()), input.size(), hash);
+        SHA256(input, ID_SIZE + encodedN.size(), hash);
 
         Fingerprint out;
         memcpy(out.buf, hash, FINGERPRINT_SIZE);
@@ -0,0 +1,183 @@
+#include <iostream>
+#include <chrono>
+#include <random>
+
+#include <hoytech/error.h>
+
+#include "negentropy.h"
+
+
+
+// Original byte-oriented implementation, used as a reference for verifying the optimised kernels
+
+struct RefAccumulator {
+    uint8_t buf[negentropy::ID_SIZE];
+
+    void add(const uint8_t *otherBuf) {
+        uint64_t currCarry = 0, nextCarry = 0;
+
+        for (size_t i = 0; i < 4; i++) {
+            uint64_t orig = 0, otherV = 0;
+            for (size_t j = 0; j < 8; j++) {
+                orig |= uint64_t(buf[i*8 + j]) << (j*8);
+                otherV |= uint64_t(otherBuf[i*8 + j]) << (j*8);
+            }
+
+            uint64_t next = orig;
+
+            next += currCarry;
+            if (next < orig) nextCarry = 1;
+
+            next += otherV;
+            if (next < otherV) nextCarry = 1;
+
+            for (size_t j = 0; j < 8; j++) buf[i*8 + j] = (next >> (j*8)) & 0xFF;
+
+            currCarry = nextCarry;
+            nextCarry = 0;
+        }
+    }
+
+    void sub(const uint8_t *otherBuf) {
+        RefAccumulator neg;
+        for (size_t i = 0; i < sizeof(buf); i++) neg.buf[i] = ~otherBuf[i];
+
+        RefAccumulator one;
+        memset(one.buf, '\0', sizeof(one.buf));
+        one.buf[0] = 1;
+        neg.add(one.buf);
+
+        add(neg.buf);
+    }
+};
+
+
+std::mt19937_64 rng(0);
+
+void randomBuf(uint8_t *buf) {
+    // Mix of random, saturated, and zero limbs, to exercise carry/borrow chains
+
+    for (size_t i = 0; i < 4; i++) {
+        uint64_t v;
+        switch (rng() % 4) {
+            case 0: v = 0; break;
+            case 1: v = negentropy::MAX_U64; break;
+            default: v = rng(); break;
+        }
+        memcpy(buf + i*8, &v, 8);
+    }
+}
+
+
+void testCorrectness() {
+    for (size_t iter = 0; iter < 1'000'000; iter++) {
+        negentropy::Accumulator acc;
+        RefAccumulator ref;
+        uint8_t other[negentropy::ID_SIZE];
+
+        randomBuf(acc.buf);
+        memcpy(ref.buf, acc.buf, sizeof(acc.buf));
+        randomBuf(other);
+
+        if (iter % 2 == 0) {
+            acc.add(other);
+            ref.add(other);
+        } else {
+            acc.sub(other);
+            ref.sub(other);
+        }
+
+        if (memcmp(acc.buf, ref.buf, sizeof(acc.buf)) != 0) throw hoytech::error("accumulator mismatch on iter ", iter);
+    }
+
+    for (size_t iter = 0; iter < 1'000; iter++) {
+        std::vector<negentropy::Item> items(rng() % 2'000);
+        for (auto &item : items) randomBuf(item.id);
+
+        negentropy::Accumulator acc, acc2;
+        randomBuf(acc.buf);
+        memcpy(acc2.buf, acc.buf, sizeof(acc.buf));
+
+        for (const auto &item : items) acc.add(item);
+        acc2.addRange(items.data(), items.data() + items.size());
+
+        if (memcmp(acc.buf, acc2.buf, sizeof(acc.buf)) != 0) throw hoytech::error("addRange mismatch on iter ", iter);
+    }
+
+    {
+        negentropy::Accumulator acc;
+        acc.setToZero();
+        acc.buf[0] = 5;
+        acc.negate();
+
+        RefAccumulator ref;
+        memset(ref.buf, '\0', sizeof(ref.buf));
+        uint8_t five[negentropy::ID_SIZE] = { 5 };
+        ref.sub(five);
+
+        if (memcmp(acc.buf, ref.buf, sizeof(acc.buf)) != 0) throw hoytech::error("negate mismatch");
+    }
+}
+
+
+template<typename F>
+void bench(const char *name, size_t n, F f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto end = std::chrono::steady_clock::now();
+
+    double ns = std::chrono::duration<double, std::nano>(end - start).count();
+    std::cout << name << ": " << (ns / n) << " ns/op" << std::endl;
+}
+
+void runBenchmarks() {
+    const size_t numItems = 1'000'000;
+    const size_t numRounds = 20;
+
+    std::vector<negentropy::Item> items(numItems);
+    for (auto &item : items) randomBuf(item.id);
+
+    negentropy::Accumulator acc;
+    acc.setToZero();
+
+    bench("add", numItems * numRounds, [&]{
+        for (size_t r = 0; r < numRounds; r++) {
+            for (const auto &item : items) acc.add(item);
+        }
+    });
+
+    bench("sub", numItems * numRounds, [&]{
+        for (size_t r = 0; r < numRounds; r++) {
+            for (const auto &item : items) acc.sub(item);
+        }
+    });
+
+    bench("addRange", numItems * numRounds, [&]{
+        for (size_t r = 0; r < numRounds; r++) {
+            acc.addRange(items.data(), items.data() + items.size());
+        }
+    });
+
+    bench("sub (undoing addRange)", numItems * numRounds, [&]{
+        for (size_t r = 0; r < numRounds; r++) {
+            for (const auto &item : items) acc.sub(item);
+        }
+    });
+
+    // Every add was matched by a sub, so we should be back to zero
+
+    for (size_t i = 0; i < sizeof(acc.buf); i++) {
+        if (acc.buf[i] != 0) throw hoytech::error("accumulator not zero after add/sub");
+    }
+}
+
+
+
+int main() {
+    testCorrectness();
+    runBenchmarks();
+
+    std::cout << "OK" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,73 @@
+#include <iostream>
+#include <chrono>
+#include <random>
+
+#include <hoytech/error.h>
+
+#include "negentropy.h"
+#include "negentropy/storage/BTreeMem.h"
+
+
+
+std::mt19937_64 rng(0);
+
+negentropy::Item randomItem(uint64_t timestamp) {
+    negentropy::Item item(timestamp);
+    for (size_t i = 0; i < negentropy::ID_SIZE; i++) item.id[i] = rng() & 0xFF;
+    return item;
+}
+
+
+template<typename F>
+void bench(const char *name, size_t n, F f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto end = std::chrono::steady_clock::now();
+
+    double ns = std::chrono::duration<double, std::nano>(end - start).count();
+    std::cout << name << ": " << (ns / n) << " ns/op" << std::endl;
+}
+
+
+
+int main() {
+    size_t numItems = 10'000'000;
+    if (::getenv("NUM_ITEMS")) numItems = std::stoull(::getenv("NUM_ITEMS"));
+
+    const size_t numLookups = 1'000'000;
+
+    // Several items share each timestamp, so that comparisons frequently fall through to the ID
+
+    std::vector<negentropy::Item> items;
+    items.reserve(numItems);
+    for (size_t i = 0; i < numItems; i++) items.push_back(randomItem(i / 4));
+    std::sort(items.begin(), items.end());
+
+    negentropy::storage::BTreeMem btree;
+    btree.bulkLoad(items.begin(), items.end());
+
+    std::vector<size_t> targets;
+    for (size_t i = 0; i < numLookups; i++) targets.push_back(rng() % numItems);
+
+    size_t check = 0;
+
+    bench("findLowerBound", numLookups, [&]{
+        for (auto t : targets) check += btree.findLowerBound(0, numItems, negentropy::Bound(items[t]));
+    });
+
+    bench("searchItem", numLookups, [&]{
+        for (auto t : targets) {
+            bool found;
+            auto breadcrumbs = btree.searchItem(btree.getRootNodeId(), items[t], found);
+            check += found;
+        }
+    });
+
+    size_t expected = 0;
+    for (auto t : targets) expected += t + 1;
+    if (check != expected) throw hoytech::error("lookup results mismatch");
+
+    std::cout << "OK" << std::endl;
+
+    return 0;
+}
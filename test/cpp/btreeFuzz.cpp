@@ -23,21 +23,24 @@ struct Verifier {
 
     Verifier(bool isLMDB) : isLMDB(isLMDB) {}
 
-    void insert(negentropy::storage::btree::BTreeCore &btree, uint64_t timestamp){
+    template<typename BTree>
+    void insert(BTree &btree, uint64_t timestamp){
         negentropy::Item item(timestamp, std::string(32, (unsigned char)(timestamp % 256)));
         btree.insertItem(item);
         addedTimestamps.insert(timestamp);
         doVerify(btree);
     }
 
-    void erase(negentropy::storage::btree::BTreeCore &btree, uint64_t timestamp){
+    template<typename BTree>
+    void erase(BTree &btree, uint64_t timestamp){
         negentropy::Item item(timestamp, std::string(32, (unsigned char)(timestamp % 256)));
         btree.eraseItem(item);
         addedTimestamps.erase(timestamp);
         doVerify(btree);
     }
 
-    void doVerify(negentropy::storage::btree::BTreeCore &btree) {
+    template<typename BTree>
+    void doVerify(BTree &btree) {
         try {
             negentropy::storage::btree::verify(btree, isLMDB);
         } catch (...) {
@@ -54,6 +57,12 @@ struct Verifier {
             iter = std::next(iter);
             return true;
         });
+
+        for (size_t i = 0; i < 10; i++) {
+            uint64_t timestamp = i % 2 ? rand() % 100'000 : rand();
+            size_t expected = std::distance(addedTimestamps.begin(), addedTimestamps.lower_bound(timestamp));
+            if (btree.findLowerBound(0, btree.size(), negentropy::Bound(timestamp)) != expected) throw negentropy::err("verify findLowerBound mismatch");
+        }
     }
 };
 
@@ -61,7 +70,8 @@ struct Verifier {
 
 
 
-void doFuzz(negentropy::storage::btree::BTreeCore &btree, Verifier &v) {
+template<typename BTree>
+void doFuzz(BTree &btree, Verifier &v) {
     if (btree.size() != 0) throw negentropy::err("expected empty tree");
 
 
@@ -110,6 +120,140 @@ void doFuzz(negentropy::storage::btree::BTreeCore &btree, Verifier &v) {
 
 
 
+template<typename BTree>
+void doBulkLoad(BTree &btree, Verifier &v, size_t num) {
+    if (btree.size() != 0) throw negentropy::err("expected empty tree");
+
+    std::vector<negentropy::Item> items;
+
+    for (size_t i = 0; i < num; i++) {
+        uint64_t timestamp = 1000 + i * 3;
+        items.emplace_back(timestamp, std::string(32, (unsigned char)(timestamp % 256)));
+        v.addedTimestamps.insert(timestamp);
+    }
+
+    std::cout << "BULKLOAD " << num << std::endl;
+    btree.bulkLoad(items.begin(), items.end());
+    v.doVerify(btree);
+
+    // Tree must remain valid when modified after loading
+
+    for (size_t i = 0; i < 200 && num; i++) {
+        if (rand() % 2 || v.addedTimestamps.empty()) {
+            v.insert(btree, 1000 + (rand() % (num * 3 + 10)) * 3 + 1);
+        } else {
+            auto it = v.addedTimestamps.begin();
+            std::advance(it, rand() % v.addedTimestamps.size());
+            v.erase(btree, *it);
+        }
+    }
+
+    while (v.addedTimestamps.size()) {
+        auto timestamp = *v.addedTimestamps.begin();
+        negentropy::Item item(timestamp, std::string(32, (unsigned char)(timestamp % 256)));
+        btree.eraseItem(item);
+        v.addedTimestamps.erase(timestamp);
+    }
+
+    v.doVerify(btree);
+}
+
+template<typename BTree>
+void doBulkLoadTests(BTree &btree, Verifier &v) {
+    const size_t MAX_ITEMS = BTree::MAX_ITEMS;
+
+    for (size_t num : { size_t(0), size_t(1), MAX_ITEMS, MAX_ITEMS + 1, MAX_ITEMS * MAX_ITEMS, MAX_ITEMS * MAX_ITEMS + 1, size_t(5000) }) {
+        doBulkLoad(btree, v, num);
+    }
+
+    {
+        std::vector<negentropy::Item> items = { negentropy::Item(2, std::string(32, '\x01')), negentropy::Item(1, std::string(32, '\x01')) };
+        bool threw = false;
+        try {
+            btree.bulkLoad(items.begin(), items.end());
+        } catch (std::exception &) {
+            threw = true;
+        }
+        if (!threw) throw negentropy::err("bulkLoad accepted unsorted items");
+    }
+}
+
+template<typename BTree>
+void doBatchFuzz(BTree &btree, Verifier &v) {
+    if (btree.size() != 0) throw negentropy::err("expected empty tree");
+
+    auto makeItem = [](uint64_t timestamp){
+        return negentropy::Item(timestamp, std::string(32, (unsigned char)(timestamp % 256)));
+    };
+
+    for (size_t iter = 0; iter < 300; iter++) {
+        std::vector<negentropy::Item> batch;
+        size_t batchSize = rand() % 300;
+        bool clustered = rand() % 2;
+        uint64_t base = rand() % 100'000;
+
+        if (iter < 150 ? rand() % 4 != 0 : rand() % 4 == 0) {
+            std::set<uint64_t> expected = v.addedTimestamps;
+
+            for (size_t i = 0; i < batchSize; i++) {
+                uint64_t timestamp = clustered ? base + (rand() % (batchSize * 2 + 1)) : rand() % 100'000;
+                batch.push_back(makeItem(timestamp));
+                expected.insert(timestamp);
+            }
+
+            std::cout << "INSERT BATCH " << batch.size() << " size = " << btree.size() << std::endl;
+            size_t numInserted = btree.insertBatch(batch.begin(), batch.end());
+            if (numInserted != expected.size() - v.addedTimestamps.size()) throw negentropy::err("insertBatch returned wrong count");
+            v.addedTimestamps = expected;
+        } else {
+            std::set<uint64_t> expected = v.addedTimestamps;
+
+            for (size_t i = 0; i < batchSize; i++) {
+                uint64_t timestamp;
+
+                if (v.addedTimestamps.size() && rand() % 4 != 0) {
+                    auto it = v.addedTimestamps.lower_bound(clustered ? base : rand() % 100'000);
+                    if (it == v.addedTimestamps.end()) it = v.addedTimestamps.begin();
+                    std::advance(it, std::min(size_t(rand() % 20), size_t(std::distance(it, v.addedTimestamps.end())) - 1));
+                    timestamp = *it;
+                } else {
+                    timestamp = rand() % 100'000;
+                }
+
+                batch.push_back(makeItem(timestamp));
+                expected.erase(timestamp);
+            }
+
+            std::cout << "ERASE BATCH " << batch.size() << " size = " << btree.size() << std::endl;
+            size_t numErased = btree.eraseBatch(batch.begin(), batch.end());
+            if (numErased != v.addedTimestamps.size() - expected.size()) throw negentropy::err("eraseBatch returned wrong count");
+            v.addedTimestamps = expected;
+        }
+
+        v.doVerify(btree);
+    }
+
+    std::vector<negentropy::Item> all;
+    for (auto timestamp : v.addedTimestamps) all.push_back(makeItem(timestamp));
+    btree.eraseBatch(all.begin(), all.end());
+    v.addedTimestamps.clear();
+    v.doVerify(btree);
+}
+
+
+
+// Small nodes cause a large amount of tree structure changes like splitting, moving, and rebalancing
+
+using FuzzGeometry = negentropy::storage::btree::Geometry<2, 4, 6>;
+
+template<typename BTree>
+void runAll(BTree &btree, Verifier &v) {
+    doFuzz(btree, v);
+    doBulkLoadTests(btree, v);
+    doBatchFuzz(btree, v);
+}
+
+
 int main() {
     std::cout << "SIZEOF NODE: " << sizeof(negentropy::storage::Node) << std::endl;
 
@@ -126,20 +270,45 @@ int main() {
         env.set_mapsize(1'000'000'000ULL);
         env.open("testdb/", 0);
 
+        // NE_FUZZ_LMDB=compact uses the compact node format
+        auto format = std::string(::getenv("NE_FUZZ_LMDB")) == "compact" ? negentropy::storage::BTreeLMDB::NodeFormat::Compact
+                                                                        : negentropy::storage::BTreeLMDB::NodeFormat::Raw;
+
         auto txn = lmdb::txn::begin(env);
-        auto btreeDbi = negentropy::storage::BTreeLMDB::setupDB(txn, "test-data");
 
-        negentropy::storage::BTreeLMDB btree(txn, btreeDbi, 0);
+        {
+            auto btreeDbi = negentropy::storage::BTreeLMDB::setupDB(txn, "test-data");
+            negentropy::storage::BTreeLMDB btree(txn, btreeDbi, 0, format);
+            if (btree.format() != format) throw hoytech::error("wrong node format");
 
-        Verifier v(true);
-        doFuzz(btree, v);
+            Verifier v(true);
+            runAll(btree, v);
+            btree.flush();
+        }
+
+        {
+            // Separate DBI, since verify() checks for leaks across the whole DBI
+            auto btreeDbi = negentropy::storage::BTreeLMDB::setupDB(txn, "test-data-small");
+            negentropy::storage::BasicBTreeLMDB<FuzzGeometry> btree(txn, btreeDbi, 0, format);
+
+            Verifier v(true);
+            runAll(btree, v);
+            btree.flush();
+        }
 
-        btree.flush();
         txn.commit();
     } else {
-        Verifier v(false);
-        negentropy::storage::BTreeMem btree;
-        doFuzz(btree, v);
+        {
+            Verifier v(false);
+            negentropy::storage::BTreeMem btree;
+            runAll(btree, v);
+        }
+
+        {
+            Verifier v(false);
+            negentropy::storage::BasicBTreeMem<FuzzGeometry> btree;
+            runAll(btree, v);
+        }
     }
 
 
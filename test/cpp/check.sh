@@ -5,5 +5,11 @@ make -j all
 
 ./btreeFuzz
 NE_FUZZ_LMDB=1 ./btreeFuzz
+NE_FUZZ_LMDB=compact ./btreeFuzz
 ./lmdbTest
+NE_LMDB_WRITEMAP=1 ./lmdbTest
 ./subRange
+./accumulatorTest
+./vectorTest
+./sessionManager
+./fingerprintCache
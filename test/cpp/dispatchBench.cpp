@@ -0,0 +1,97 @@
+#include <iostream>
+#include <chrono>
+#include <random>
+
+#include <hoytech/error.h>
+
+#include "negentropy.h"
+#include "negentropy/storage/Vector.h"
+#include "negentropy/storage/BTreeMem.h"
+
+
+
+// Compares reconciliation through the virtual StorageBase interface with the statically
+// dispatched path that Negentropy uses when given a concrete storage type.
+
+std::mt19937_64 rng(0);
+
+negentropy::Item randomItem(uint64_t timestamp) {
+    negentropy::Item item(timestamp);
+    for (size_t i = 0; i < negentropy::ID_SIZE; i++) item.id[i] = rng() & 0xFF;
+    return item;
+}
+
+
+template<typename S1, typename S2>
+void bench(const char *name, S1 &storage1, S2 &storage2, size_t expectedHaves, size_t expectedNeeds) {
+    auto start = std::chrono::steady_clock::now();
+
+    Negentropy<S1> ne1(storage1, 500'000);
+    Negentropy<S2> ne2(storage2, 500'000);
+
+    std::string msg = ne1.initiate();
+    size_t numHaves = 0, numNeeds = 0, rounds = 0;
+
+    while (true) {
+        msg = ne2.reconcile(msg);
+        rounds++;
+
+        auto newMsg = ne1.reconcile(msg, [&](const negentropy::Item &){ numHaves++; }, [&](std::string_view){ numNeeds++; });
+
+        if (!newMsg) break;
+        else std::swap(msg, *newMsg);
+    }
+
+    auto end = std::chrono::steady_clock::now();
+
+    if (numHaves != expectedHaves || numNeeds != expectedNeeds) throw hoytech::error("unexpected have/need counts");
+
+    double ms = std::chrono::duration<double, std::milli>(end - start).count();
+    std::cout << name << ": " << ms << " ms (" << rounds << " rounds)" << std::endl;
+}
+
+
+int main() {
+    size_t numItems = 10'000'000;
+    if (::getenv("NUM_ITEMS")) numItems = std::stoull(::getenv("NUM_ITEMS"));
+
+    // Each side is missing a different 0.1% of the items
+
+    std::vector<negentropy::Item> items1, items2;
+    size_t expectedHaves = 0, expectedNeeds = 0;
+
+    for (size_t i = 0; i < numItems; i++) {
+        auto item = randomItem(i / 4);
+        if (i % 1000 == 1) expectedNeeds++;
+        else items1.push_back(item);
+        if (i % 1000 == 2) expectedHaves++;
+        else items2.push_back(item);
+    }
+
+    std::sort(items1.begin(), items1.end());
+    std::sort(items2.begin(), items2.end());
+
+    {
+        negentropy::storage::Vector vec1, vec2;
+        vec1.items = items1;
+        vec2.items = items2;
+        vec1.seal();
+        vec2.seal();
+
+        bench<negentropy::StorageBase, negentropy::StorageBase>("Vector virtual", vec1, vec2, expectedHaves, expectedNeeds);
+        bench("Vector static", vec1, vec2, expectedHaves, expectedNeeds);
+    }
+
+    {
+        negentropy::storage::BTreeMem btree1, btree2;
+        btree1.bulkLoad(items1.begin(), items1.end());
+        btree2.bulkLoad(items2.begin(), items2.end());
+
+        bench<negentropy::StorageBase, negentropy::StorageBase>("BTreeMem virtual", btree1, btree2, expectedHaves, expectedNeeds);
+        bench("BTreeMem static", btree1, btree2, expectedHaves, expectedNeeds);
+    }
+
+    std::cout << "OK" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,117 @@
+#include <iostream>
+#include <chrono>
+#include <random>
+
+#include <hoytech/error.h>
+
+#include "negentropy.h"
+#include "negentropy/storage/BTreeMem.h"
+#include "negentropy/storage/BTreeLMDB.h"
+
+
+
+// Sweeps B-tree node sizes, printing one JSON object per line with insert and fingerprint throughput.
+//
+// Environment variables:
+//   BENCH_SIZE      number of items in each tree (default 1000000)
+//   BENCH_LMDB_DIR  if set, BTreeLMDB is also measured, using a database in this directory
+
+
+std::mt19937_64 rng(0);
+
+negentropy::Item randomItem(uint64_t timestamp) {
+    negentropy::Item item(timestamp);
+    for (size_t i = 0; i < negentropy::ID_SIZE; i += 8) {
+        uint64_t r = rng();
+        memcpy(item.id + i, &r, 8);
+    }
+    return item;
+}
+
+uint64_t check = 0; // prevents results from being optimised away
+
+
+// Same proportions as the default geometry (30/60/80), rounded down to even numbers
+
+template<size_t MaxItems>
+using FanoutGeometry = negentropy::storage::btree::Geometry<MaxItems * 3 / 8 / 2 * 2, MaxItems * 3 / 4 / 2 * 2, MaxItems>;
+
+
+template<typename BTree>
+void bench(const char *storage, BTree &btree, const std::vector<negentropy::Item> &items) {
+    const size_t numFingerprints = 100'000;
+
+    auto start = std::chrono::steady_clock::now();
+    for (const auto &item : items) check += btree.insertItem(item);
+    auto mid = std::chrono::steady_clock::now();
+
+    size_t size = btree.size();
+
+    for (size_t i = 0; i < numFingerprints; i++) {
+        size_t begin = rng() % size;
+        size_t end = begin + rng() % (size - begin + 1);
+        check += btree.fingerprint(begin, end).buf[0];
+    }
+
+    auto end = std::chrono::steady_clock::now();
+
+    double insertNs = std::chrono::duration<double, std::nano>(mid - start).count() / items.size();
+    double fingerprintNs = std::chrono::duration<double, std::nano>(end - mid).count() / numFingerprints;
+
+    std::cout << "{\"storage\":\"" << storage << "\",\"max_items\":" << BTree::MAX_ITEMS
+              << ",\"node_bytes\":" << sizeof(typename BTree::Node) << ",\"size\":" << size
+              << ",\"insert_ns_per_op\":" << insertNs << ",\"fingerprint_ns_per_op\":" << fingerprintNs << "}" << std::endl;
+}
+
+template<size_t MaxItems>
+void benchMem(const std::vector<negentropy::Item> &items) {
+    negentropy::storage::BasicBTreeMem<FanoutGeometry<MaxItems>> btree;
+    bench("btreemem", btree, items);
+}
+
+template<size_t MaxItems>
+void benchLMDB(lmdb::env &env, const std::vector<negentropy::Item> &items) {
+    auto txn = lmdb::txn::begin(env);
+    auto dbi = negentropy::storage::BTreeLMDB::setupDB(txn, "fanout-" + std::to_string(MaxItems));
+
+    {
+        negentropy::storage::BasicBTreeLMDB<FanoutGeometry<MaxItems>> btree(txn, dbi, 0);
+        bench("btreelmdb", btree, items);
+    }
+
+    txn.abort();
+}
+
+template<size_t... MaxItems>
+void sweep(const std::vector<negentropy::Item> &items, lmdb::env *env) {
+    (benchMem<MaxItems>(items), ...);
+    if (env) (benchLMDB<MaxItems>(*env, items), ...);
+}
+
+
+
+int main() {
+    size_t size = ::getenv("BENCH_SIZE") ? std::stoull(::getenv("BENCH_SIZE")) : 1'000'000;
+
+    std::vector<negentropy::Item> items;
+    for (size_t i = 0; i < size; i++) items.push_back(randomItem(rng() % (size / 4 + 1)));
+
+    std::optional<lmdb::env> env;
+
+    if (::getenv("BENCH_LMDB_DIR")) {
+        std::string dir = ::getenv("BENCH_LMDB_DIR");
+        system((std::string("mkdir -p ") + dir).c_str());
+        system((std::string("rm -f ") + dir + "/*").c_str());
+
+        env = lmdb::env::create();
+        env->set_max_dbs(64);
+        env->set_mapsize(1ULL << 40);
+        env->open(dir.c_str(), 0);
+    }
+
+    sweep<8, 16, 32, 64, 80, 128, 256>(items, env ? &*env : nullptr);
+
+    if (check == 0) std::cerr << "unexpected check value" << std::endl;
+
+    return 0;
+}
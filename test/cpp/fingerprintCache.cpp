@@ -0,0 +1,268 @@
+#include <iostream>
+
+#include <openssl/sha.h>
+
+#include <hoytech/error.h>
+#include <hoytech/hex.h>
+
+#include "negentropy.h"
+#include "negentropy/storage/Vector.h"
+#include "negentropy/storage/BTreeMem.h"
+#include "negentropy/storage/SubRange.h"
+#include "negentropy/storage/FingerprintCache.h"
+
+
+
+std::string sha256(std::string_view input) {
+    unsigned char hash[SHA256_DIGEST_LENGTH];
+    SHA256(reinterpret_cast<const unsigned char*>(input.data()), input.size(), hash);
+    return std::string((const char*)&hash[0], SHA256_DIGEST_LENGTH);
+}
+
+std::string uintToId(uint64_t id) {
+    return sha256(std::string((char*)&id, 8));
+}
+
+
+void checkSame(negentropy::StorageBase &base, negentropy::storage::FingerprintCache &cache) {
+    size_t size = base.size();
+    if (cache.size() != size) throw hoytech::error("size mismatch");
+
+    for (size_t i = 0; i < 200; i++) {
+        size_t begin = rand() % (size + 1);
+        size_t end = begin + rand() % (size - begin + 1);
+
+        if (cache.fingerprint(begin, end).sv() != base.fingerprint(begin, end).sv()) throw hoytech::error("fingerprint mismatch");
+
+        auto bound = negentropy::Bound(100 + rand() % (size + 200));
+        if (cache.findLowerBound(begin, end, bound) != base.findLowerBound(begin, end, bound)) throw hoytech::error("findLowerBound mismatch");
+
+        auto buckets = cache.fingerprintBuckets(begin, end, 16);
+        auto expected = base.fingerprintBuckets(begin, end, 16);
+
+        for (size_t j = 0; j < 16; j++) {
+            if (buckets[j].fingerprint.sv() != expected[j].fingerprint.sv()) throw hoytech::error("bucket fingerprint mismatch");
+            if (buckets[j].firstItem != expected[j].firstItem) throw hoytech::error("bucket firstItem mismatch");
+            if (buckets[j].lastItem != expected[j].lastItem) throw hoytech::error("bucket lastItem mismatch");
+        }
+    }
+}
+
+
+template<typename T>
+void testCache() {
+    T storage;
+
+    for (size_t i = 0; i < 5000; i++) {
+        storage.insert(100 + i, uintToId(i));
+    }
+
+    storage.seal();
+
+    negentropy::storage::FingerprintCache cache(storage);
+
+    // Misses then hits
+
+    cache.fingerprint(10, 4000);
+    cache.fingerprint(10, 4000);
+    cache.findLowerBound(0, 5000, negentropy::Bound(1000));
+    cache.findLowerBound(0, 5000, negentropy::Bound(1000));
+
+    {
+        auto stats = cache.getStats();
+        if (stats.fingerprintMisses != 1 || stats.fingerprintHits != 1) throw hoytech::error("unexpected fingerprint stats");
+        if (stats.lowerBoundMisses != 1 || stats.lowerBoundHits != 1) throw hoytech::error("unexpected lowerBound stats");
+    }
+
+    // Buckets are cached individually
+
+    cache.resetStats();
+    cache.fingerprintBuckets(0, 5000, 16);
+    cache.fingerprintBuckets(0, 5000, 16);
+    cache.fingerprint(0, negentropy::bucketBoundary(0, 5000, 16, 1));
+
+    {
+        auto stats = cache.getStats();
+        if (stats.fingerprintMisses != 16 || stats.fingerprintHits != 17) throw hoytech::error("unexpected bucket stats");
+    }
+
+    checkSame(storage, cache);
+
+    // Modifying the storage invalidates the cache
+
+    auto origFp = cache.fingerprint(0, 5000);
+
+    storage.unseal();
+    storage.insert(50, uintToId(999'999));
+    storage.seal();
+
+    if (cache.fingerprint(0, 5000).sv() == origFp.sv()) throw hoytech::error("stale fingerprint after modification");
+    if (cache.getStats().invalidations == 0) throw hoytech::error("invalidation not counted");
+
+    checkSame(storage, cache);
+
+    // Size limit
+
+    cache.maxEntries = 10;
+    cache.clear();
+    cache.resetStats();
+
+    for (size_t i = 0; i < 20; i++) cache.fingerprint(0, i);
+    cache.fingerprint(0, 19); // most recent: kept
+    cache.fingerprint(0, 0); // least recent: evicted
+
+    {
+        auto stats = cache.getStats();
+        if (stats.fingerprintHits != 1 || stats.fingerprintMisses != 21) throw hoytech::error("unexpected LRU behaviour");
+    }
+}
+
+
+// Counts getItem() calls made on a Vector
+
+struct CountingStorage : negentropy::StorageBase {
+    negentropy::storage::Vector &base;
+    size_t numGetItem = 0;
+
+    CountingStorage(negentropy::storage::Vector &base) : base(base) {}
+
+    uint64_t size() { return base.size(); }
+    const negentropy::Item &getItem(size_t i) { numGetItem++; return base.getItem(i); }
+    void iterate(size_t begin, size_t end, std::function<bool(const negentropy::Item &, size_t)> cb) { base.iterate(begin, end, cb); }
+    size_t findLowerBound(size_t begin, size_t end, const negentropy::Bound &bound) { return base.findLowerBound(begin, end, bound); }
+    negentropy::Fingerprint fingerprint(size_t begin, size_t end) { return base.fingerprint(begin, end); }
+    std::optional<uint64_t> version() { return base.version(); }
+};
+
+void testBucketItemsCached() {
+    negentropy::storage::Vector storage;
+    for (size_t i = 0; i < 5000; i++) storage.insert(100 + i, uintToId(i));
+    storage.seal();
+
+    CountingStorage counting(storage);
+    negentropy::storage::FingerprintCache cache(counting);
+
+    // Buckets first cached by fingerprint() have their boundary items looked up once
+
+    for (size_t i = 0; i < 16; i++) cache.fingerprint(negentropy::bucketBoundary(0, 5000, 16, i), negentropy::bucketBoundary(0, 5000, 16, i + 1));
+
+    counting.numGetItem = 0;
+    cache.fingerprintBuckets(0, 5000, 16);
+    if (counting.numGetItem != 32) throw hoytech::error("expected boundary items to be looked up");
+
+    counting.numGetItem = 0;
+    auto buckets = cache.fingerprintBuckets(0, 5000, 16);
+    if (counting.numGetItem != 0) throw hoytech::error("fully cached buckets consulted base storage");
+
+    auto expected = storage.fingerprintBuckets(0, 5000, 16);
+
+    for (size_t j = 0; j < 16; j++) {
+        if (buckets[j].fingerprint.sv() != expected[j].fingerprint.sv()) throw hoytech::error("bucket fingerprint mismatch");
+        if (buckets[j].firstItem != expected[j].firstItem || buckets[j].lastItem != expected[j].lastItem) throw hoytech::error("bucket item mismatch");
+    }
+}
+
+// Storage that doesn't report a version can't be cached, since changes to it wouldn't be noticed
+
+struct UnversionedStorage : CountingStorage {
+    using CountingStorage::CountingStorage;
+    std::optional<uint64_t> version() { return std::nullopt; }
+};
+
+void testUnversioned() {
+    negentropy::storage::Vector storage;
+    storage.seal();
+
+    UnversionedStorage unversioned(storage);
+    bool threw = false;
+
+    try {
+        negentropy::storage::FingerprintCache cache(unversioned);
+    } catch (std::exception &) {
+        threw = true;
+    }
+
+    if (!threw) throw hoytech::error("cache accepted storage without a version");
+}
+
+
+void testSubRange() {
+    negentropy::storage::BTreeMem storage;
+
+    for (size_t i = 0; i < 5000; i++) {
+        storage.insert(100 + i, uintToId(i));
+    }
+
+    negentropy::storage::SubRange subRange(storage, negentropy::Bound(1000), negentropy::Bound(3000));
+    negentropy::storage::FingerprintCache cache(subRange);
+
+    checkSame(subRange, cache);
+
+    // Changes to the underlying storage are seen through the SubRange
+
+    auto v = cache.version();
+    storage.insert(2000, uintToId(999'999));
+    if (cache.version() == v) throw hoytech::error("version not propagated");
+
+    // Operations that don't change anything don't invalidate the cache
+
+    v = cache.version();
+    storage.insert(2000, uintToId(999'999));
+    storage.erase(2000, uintToId(888'888));
+    if (cache.version() != v) throw hoytech::error("version changed by no-op");
+}
+
+
+void testSync() {
+    negentropy::storage::Vector storage1, storage2;
+
+    for (size_t i = 0; i < 50'000; i++) {
+        if (i % 1000 != 1) storage1.insert(100 + i, uintToId(i));
+        if (i % 1000 != 2) storage2.insert(100 + i, uintToId(i));
+    }
+
+    storage1.seal();
+    storage2.seal();
+
+    negentropy::storage::FingerprintCache cache(storage2);
+
+    for (size_t round = 0; round < 2; round++) {
+        auto ne1 = Negentropy(storage1, 20'000);
+        auto ne2 = Negentropy(cache, 20'000);
+
+        std::string msg = ne1.initiate();
+        size_t numHave = 0, numNeed = 0;
+
+        while (true) {
+            msg = ne2.reconcile(msg);
+
+            std::vector<std::string> have, need;
+            auto newMsg = ne1.reconcile(msg, have, need);
+            numHave += have.size();
+            numNeed += need.size();
+
+            if (!newMsg) break;
+            else std::swap(msg, *newMsg);
+        }
+
+        if (numHave != 50 || numNeed != 50) throw hoytech::error("wrong have/need count");
+    }
+
+    auto stats = cache.getStats();
+    if (stats.fingerprintHits == 0 || stats.fingerprintHits != stats.fingerprintMisses) throw hoytech::error("second sync not served from cache");
+}
+
+
+
+int main() {
+    testCache<negentropy::storage::Vector>();
+    testCache<negentropy::storage::BTreeMem>();
+    testBucketItemsCached();
+    testUnversioned();
+    testSubRange();
+    testSync();
+
+    std::cout << "OK" << std::endl;
+
+    return 0;
+}
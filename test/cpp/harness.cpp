@@ -30,6 +30,7 @@ int main() {
     if (::getenv("FRAMESIZELIMIT")) frameSizeLimit = std::stoull(::getenv("FRAMESIZELIMIT"));
 
     negentropy::storage::Vector storage;
+    if (::getenv("PREFIXSTRIDE")) storage.prefixStride = std::stoull(::getenv("PREFIXSTRIDE"));
     std::unique_ptr<Negentropy<negentropy::storage::Vector>> ne;
 
     std::string line;
@@ -47,6 +48,7 @@ int main() {
         } else if (items[0] == "seal") {
             storage.seal();
             ne = std::make_unique<Negentropy<negentropy::storage::Vector>>(storage, frameSizeLimit);
+            if (::getenv("RECONCILETHREADS")) ne->reconcileThreads = std::stoull(::getenv("RECONCILETHREADS"));
         } else if (items[0] == "initiate") {
             auto q = ne->initiate();
             if (frameSizeLimit && q.size() > frameSizeLimit) throw hoytech::error("initiate frameSizeLimit exceeded: ", q.size(), " > ", frameSizeLimit);
@@ -56,11 +58,11 @@ int main() {
             if (items.size() >= 2) q = hoytech::from_hex(items[1]);
 
             if (ne->isInitiator) {
-                std::vector<std::string> have, need;
-                auto resp = ne->reconcile(q, have, need);
-
-                for (auto &id : have) std::cout << "have," << hoytech::to_hex(id) << "\n";
-                for (auto &id : need) std::cout << "need," << hoytech::to_hex(id) << "\n";
+                auto resp = ne->reconcile(q, [](const negentropy::Item &item){
+                    std::cout << "have," << hoytech::to_hex(item.getId()) << "\n";
+                }, [](std::string_view id){
+                    std::cout << "need," << hoytech::to_hex(id) << "\n";
+                });
 
                 if (!resp) {
                     std::cout << "done" << std::endl;
@@ -24,7 +24,8 @@ int main() {
 
     auto env = lmdb::env::create();
     env.set_max_dbs(64);
-    env.open("testdb/", 0);
+    bool writeMap = ::getenv("NE_LMDB_WRITEMAP"); // exercises in-place node writes
+    env.open("testdb/", writeMap ? MDB_WRITEMAP : 0);
 
 
     lmdb::dbi btreeDbi;
@@ -53,6 +54,7 @@ int main() {
     {
         auto txn = lmdb::txn::begin(env);
         negentropy::storage::BTreeLMDB btree(txn, btreeDbi, 300);
+        if (btree.inPlaceWrites != writeMap) throw hoytech::error("unexpected inPlaceWrites");
 
         auto add = [&](uint64_t timestamp){
             negentropy::Item item(timestamp, packId(timestamp));
@@ -81,6 +83,31 @@ int main() {
 
 
 
+    // The same items in a tree using the compact node format
+
+    {
+        auto txn = lmdb::txn::begin(env);
+        negentropy::storage::BTreeLMDB btree(txn, btreeDbi, 301, negentropy::storage::BTreeLMDB::NodeFormat::Compact);
+        for (size_t i = 1000; i < 2000; i += 2) btree.insert(i, packId(i));
+        btree.flush();
+        txn.commit();
+    }
+
+    {
+        auto txn = lmdb::txn::begin(env, 0, MDB_RDONLY);
+        negentropy::storage::BTreeLMDB raw(txn, btreeDbi, 300);
+        negentropy::storage::BTreeLMDB compact(txn, btreeDbi, 301); // format comes from the tree's metadata
+
+        if (raw.format() != negentropy::storage::BTreeLMDB::NodeFormat::Raw) throw hoytech::error("expected raw format");
+        if (compact.format() != negentropy::storage::BTreeLMDB::NodeFormat::Compact) throw hoytech::error("expected compact format");
+
+        if (compact.size() != raw.size()) throw hoytech::error("compact tree size differs");
+        if (compact.fingerprint(0, compact.size()).sv() != raw.fingerprint(0, raw.size()).sv()) throw hoytech::error("compact tree fingerprint differs");
+        if (compact.getItem(123).timestamp != raw.getItem(123).timestamp) throw hoytech::error("compact tree item differs");
+    }
+
+
+
     // Identical
 
     {
@@ -151,6 +178,43 @@ int main() {
     }
 
 
+    // Reconcile again, streaming Items and need ranges
+
+    {
+        auto txn = lmdb::txn::begin(env, 0, MDB_RDONLY);
+        negentropy::storage::BTreeLMDB btree(txn, btreeDbi, 300);
+
+        auto ne1 = Negentropy(vec);
+        auto ne2 = Negentropy(btree);
+
+        std::vector<uint64_t> allHave, allNeed;
+
+        std::string msg = ne1.initiate();
+
+        while (true) {
+            std::string response = ne2.reconcile(msg);
+
+            auto newMsg = ne1.reconcile(response, [&](const negentropy::Item &item){
+                if (item.timestamp != unpackId(item.getId())) throw hoytech::error("bad have timestamp");
+                allHave.push_back(item.timestamp);
+            }, [&](std::string_view id, const negentropy::Bound &lower, const negentropy::Bound &upper){
+                negentropy::Item item(unpackId(id), id);
+                if (item < lower.item || !(item < upper.item)) throw hoytech::error("need outside of range");
+                allNeed.push_back(item.timestamp);
+            });
+
+            if (!newMsg) break; // done
+            msg = *newMsg;
+        }
+
+        std::sort(allHave.begin(), allHave.end());
+        std::sort(allNeed.begin(), allNeed.end());
+
+        if (allHave != std::vector<uint64_t>({ 1044, 1838 })) throw hoytech::error("bad allHave (streaming)");
+        if (allNeed != std::vector<uint64_t>({ 1555, 99999 })) throw hoytech::error("bad allNeed (streaming)");
+    }
+
+
     std::cout << "OK" << std::endl;
 
     return 0;
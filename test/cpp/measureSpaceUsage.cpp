@@ -3,6 +3,9 @@
 
 #include <sstream>
 #include <memory>
+#include <random>
+#include <algorithm>
+#include <utility>
 
 #include <hoytech/error.h>
 #include <hoytech/hex.h>
@@ -18,35 +21,39 @@
 
 
 
-int main() {
-    system("mkdir -p testdb/");
-    system("rm -f testdb/*");
+// Prints, for each node format and insertion order:
+//   data,<format>,<order>,MAX_ITEMS,sizeof(Node),<number of nodes>,<total bytes of node records>,<bytes of LMDB pages used>
+//
+// By default the production geometry is measured. With the argument "sweep", MAX_ITEMS is varied
+// from 6 to 126 in steps of 8 instead (with MIN_ITEMS 2 and REBALANCE_THRESHOLD 4).
 
-    auto env = lmdb::env::create();
-    env.set_max_dbs(64);
-    env.set_mapsize(1'000'000'000ULL);
-    env.open("testdb/", 0);
+using NodeFormat = negentropy::storage::BTreeLMDBNodeFormat;
 
+template<typename G>
+void measure(lmdb::env &env, NodeFormat format, bool randomOrder) {
+    using BTree = negentropy::storage::BasicBTreeLMDB<G>;
 
+    std::string tableName = std::string("space-") + (format == NodeFormat::Compact ? "compact" : "raw") + (randomOrder ? "-random" : "-append");
     lmdb::dbi btreeDbi;
 
     {
         auto txn = lmdb::txn::begin(env);
-        btreeDbi = negentropy::storage::BTreeLMDB::setupDB(txn, "test-data");
+        btreeDbi = BTree::setupDB(txn, tableName);
         txn.commit();
     }
 
-
     {
         auto txn = lmdb::txn::begin(env);
-        negentropy::storage::BTreeLMDB btree(txn, btreeDbi, 300);
+        BTree btree(txn, btreeDbi, 300, format);
+
+        std::vector<uint64_t> timestamps;
+        for (size_t i = 1; i < 100'000; i++) timestamps.push_back(i);
+        if (randomOrder) std::shuffle(timestamps.begin(), timestamps.end(), std::mt19937(0));
 
-        auto add = [&](uint64_t timestamp){
+        for (auto timestamp : timestamps) {
             negentropy::Item item(timestamp, std::string(32, '\x01'));
             btree.insertItem(item);
-        };
-
-        for (size_t i = 1; i < 100'000; i++) add(i);
+        }
 
         btree.flush();
         txn.commit();
@@ -54,25 +61,65 @@ int main() {
 
     {
         auto txn = lmdb::txn::begin(env, 0, MDB_RDONLY);
-        negentropy::storage::BTreeLMDB btree(txn, btreeDbi, 300);
 
         auto cursor = lmdb::cursor::open(txn, btreeDbi);
 
         std::string_view key, val;
-        size_t minStart = negentropy::MAX_U64;
-        size_t maxEnd = 0;
+        size_t numNodes = 0;
+        size_t recordBytes = 0;
 
         if (cursor.get(key, val, MDB_FIRST)) {
             do {
-                size_t ptrStart = (size_t)val.data();
-                size_t ptrEnd = ptrStart + sizeof(negentropy::storage::btree::Node);
-                if (ptrStart < minStart) minStart = ptrStart;
-                if (ptrEnd > maxEnd) maxEnd = ptrEnd;
+                if (lmdb::from_sv<uint64_t>(key.substr(8)) == 0) continue; // metadata
+                numNodes++;
+                recordBytes += val.size();
             } while (cursor.get(key, val, MDB_NEXT));
         }
 
-        std::cout << "data," << negentropy::storage::btree::MAX_ITEMS << "," << sizeof(negentropy::storage::btree::Node) << "," << (maxEnd - minStart) << std::endl;
+        MDB_stat stat;
+        if (mdb_stat(txn, btreeDbi.handle(), &stat)) throw hoytech::error("mdb_stat failed");
+        size_t pageBytes = (stat.ms_branch_pages + stat.ms_leaf_pages + stat.ms_overflow_pages) * stat.ms_psize;
+
+        std::cout << "data," << (format == NodeFormat::Compact ? "compact" : "raw")
+                  << "," << (randomOrder ? "random" : "append")
+                  << "," << G::MAX_ITEMS << "," << sizeof(typename BTree::Node)
+                  << "," << numNodes << "," << recordBytes << "," << pageBytes << std::endl;
+    }
+
+    // Drop the table, so the next geometry starts from an empty one
+
+    {
+        auto txn = lmdb::txn::begin(env);
+        btreeDbi.drop(txn, true);
+        txn.commit();
     }
+}
+
+template<typename G>
+void measureAll(lmdb::env &env) {
+    measure<G>(env, NodeFormat::Raw, false);
+    measure<G>(env, NodeFormat::Compact, false);
+    measure<G>(env, NodeFormat::Raw, true);
+    measure<G>(env, NodeFormat::Compact, true);
+}
+
+template<size_t... Is>
+void sweep(lmdb::env &env, std::index_sequence<Is...>) {
+    (measureAll<negentropy::storage::btree::Geometry<2, 4, 6 + Is * 8>>(env), ...);
+}
+
+
+int main(int argc, char **argv) {
+    system("mkdir -p testdb/");
+    system("rm -f testdb/*");
+
+    auto env = lmdb::env::create();
+    env.set_max_dbs(64);
+    env.set_mapsize(1'000'000'000ULL);
+    env.open("testdb/", 0);
+
+    if (argc > 1 && std::string(argv[1]) == "sweep") sweep(env, std::make_index_sequence<16>());
+    else measureAll<negentropy::storage::btree::DefaultGeometry>(env);
 
     return 0;
 }
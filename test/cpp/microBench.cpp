@@ -0,0 +1,274 @@
+#include <iostream>
+#include <sstream>
+#include <chrono>
+#include <random>
+#include <ctime>
+
+#include <hoytech/error.h>
+
+#include "negentropy.h"
+#include "negentropy/storage/Vector.h"
+#include "negentropy/storage/BTreeMem.h"
+#include "negentropy/storage/BTreeLMDB.h"
+
+
+
+// Prints one JSON object per line, so results can be collected and compared between builds.
+//
+// Environment variables:
+//   BENCH_SIZES           comma-separated item counts for storage benchmarks (default 1000000,10000000)
+//   BENCH_RECONCILE_SIZE  item count for reconciliation benchmarks (default 1000000)
+//   BENCH_FRAMESIZELIMIT  frameSizeLimit used for reconciliation (default 0, unlimited)
+//   BENCH_FILTER          only run benchmarks whose name starts with this
+//   BENCH_LMDB_DIR        directory for the LMDB benchmark database (default testdb-bench/)
+//   BENCH_LMDB_WRITEMAP   if set, the LMDB environment is opened with MDB_WRITEMAP (in-place node writes)
+
+
+std::mt19937_64 rng(0);
+
+negentropy::Item randomItem(uint64_t timestamp) {
+    negentropy::Item item(timestamp);
+    for (size_t i = 0; i < negentropy::ID_SIZE; i += 8) {
+        uint64_t r = rng();
+        memcpy(item.id + i, &r, 8);
+    }
+    return item;
+}
+
+// Several items share each timestamp, so that comparisons frequently fall through to the ID
+
+std::vector<negentropy::Item> sortedItems(size_t n) {
+    std::vector<negentropy::Item> items;
+    items.reserve(n);
+    for (size_t i = 0; i < n; i++) items.push_back(randomItem(i / 4));
+    std::sort(items.begin(), items.end());
+    return items;
+}
+
+std::string getEnv(const char *name, const char *def) {
+    auto *v = ::getenv(name);
+    return v ? v : def;
+}
+
+bool enabled(std::string_view name) {
+    return name.starts_with(getEnv("BENCH_FILTER", ""));
+}
+
+uint64_t check = 0; // prevents results from being optimised away
+
+
+template<typename F>
+void timeOps(std::string_view name, size_t size, size_t ops, F f) {
+    if (!enabled(name)) return;
+
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto end = std::chrono::steady_clock::now();
+
+    double ns = std::chrono::duration<double, std::nano>(end - start).count();
+
+    std::cout << "{\"bench\":\"" << name << "\",\"size\":" << size << ",\"ops\":" << ops << ",\"ns_per_op\":" << (ns / ops) << "}" << std::endl;
+}
+
+
+
+void benchAccumulator() {
+    const size_t numItems = 1'000'000;
+    auto items = sortedItems(numItems);
+
+    negentropy::Accumulator accum;
+    accum.setToZero();
+
+    timeOps("accumulator.add", numItems, numItems, [&]{
+        for (const auto &item : items) accum.add(item);
+    });
+
+    timeOps("accumulator.sub", numItems, numItems, [&]{
+        for (const auto &item : items) accum.sub(item);
+    });
+
+    timeOps("accumulator.addRange", numItems, numItems, [&]{
+        accum.addRange(items.data(), items.data() + items.size());
+    });
+
+    const size_t numFingerprints = 100'000;
+
+    timeOps("accumulator.getFingerprint", numItems, numFingerprints, [&]{
+        for (size_t i = 0; i < numFingerprints; i++) check += accum.getFingerprint(i).buf[0];
+    });
+}
+
+
+void benchVectorSeal(size_t size) {
+    if (!enabled("vector.seal")) return;
+
+    negentropy::storage::Vector vec;
+    vec.items.reserve(size);
+    for (size_t i = 0; i < size; i++) vec.items.push_back(randomItem(rng() % (size / 4 + 1)));
+
+    timeOps("vector.seal", size, size, [&]{
+        vec.seal();
+    });
+}
+
+
+// Times operations against a tree that already holds size items
+
+template<typename BTree>
+void benchBTree(const std::string &prefix, BTree &btree, const std::vector<negentropy::Item> &items) {
+    size_t size = items.size();
+    const size_t numUpdates = 100'000;
+    const size_t numLookups = 100'000;
+    const size_t numFingerprints = 10'000;
+
+    std::vector<negentropy::Item> newItems;
+    for (size_t i = 0; i < numUpdates; i++) newItems.push_back(randomItem(rng() % (size / 4 + 1)));
+
+    timeOps(prefix + ".insert", size, numUpdates, [&]{
+        for (const auto &item : newItems) check += btree.insertItem(item);
+    });
+
+    timeOps(prefix + ".erase", size, numUpdates, [&]{
+        for (const auto &item : newItems) check += btree.eraseItem(item);
+    });
+
+    timeOps(prefix + ".findLowerBound", size, numLookups, [&]{
+        for (size_t i = 0; i < numLookups; i++) check += btree.findLowerBound(0, size, negentropy::Bound(items[rng() % size]));
+    });
+
+    timeOps(prefix + ".fingerprint", size, numFingerprints, [&]{
+        for (size_t i = 0; i < numFingerprints; i++) {
+            size_t begin = rng() % size;
+            size_t end = begin + rng() % (size - begin + 1);
+            check += btree.fingerprint(begin, end).buf[0];
+        }
+    });
+}
+
+void benchBTreeMem(size_t size) {
+    if (!enabled("btreemem")) return;
+
+    auto items = sortedItems(size);
+
+    negentropy::storage::BTreeMem btree;
+    btree.bulkLoad(items.begin(), items.end());
+
+    benchBTree("btreemem", btree, items);
+}
+
+void benchBTreeLMDB(lmdb::env &env, lmdb::dbi dbi, size_t size) {
+    if (!enabled("btreelmdb")) return;
+
+    auto items = sortedItems(size);
+
+    auto txn = lmdb::txn::begin(env);
+
+    {
+        negentropy::storage::BTreeLMDB btree(txn, dbi, size);
+        btree.bulkLoad(items.begin(), items.end());
+        btree.flush();
+
+        benchBTree("btreelmdb", btree, items);
+    }
+
+    txn.abort();
+}
+
+
+// Each item is missing from one side with probability diffRate
+
+void benchReconcile(size_t size, double diffRate, uint64_t frameSizeLimit) {
+    if (!enabled("reconcile")) return;
+
+    negentropy::storage::Vector storage1, storage2;
+    std::uniform_real_distribution<double> dist(0.0, 1.0);
+
+    for (size_t i = 0; i < size; i++) {
+        auto item = randomItem(i / 4);
+        double r = dist(rng);
+        if (r >= diffRate / 2) storage1.items.push_back(item);
+        if (r < diffRate / 2 || r >= diffRate) storage2.items.push_back(item);
+    }
+
+    storage1.seal();
+    storage2.seal();
+
+    auto wallStart = std::chrono::steady_clock::now();
+    auto cpuStart = std::clock();
+
+    Negentropy ne1(storage1, frameSizeLimit);
+    Negentropy ne2(storage2, frameSizeLimit);
+
+    std::string msg = ne1.initiate();
+    uint64_t rounds = 0, bytes = msg.size(), numDiffs = 0;
+
+    while (true) {
+        msg = ne2.reconcile(msg);
+        bytes += msg.size();
+        rounds++;
+
+        auto newMsg = ne1.reconcile(msg, [&](const negentropy::Item &){ numDiffs++; }, [&](std::string_view){ numDiffs++; });
+        if (!newMsg) break;
+
+        bytes += newMsg->size();
+        std::swap(msg, *newMsg);
+    }
+
+    auto cpuEnd = std::clock();
+    auto wallEnd = std::chrono::steady_clock::now();
+
+    if (numDiffs != size - storage1.size() + size - storage2.size()) throw hoytech::error("reconcile found wrong number of differences");
+
+    std::cout << "{\"bench\":\"reconcile\",\"size\":" << size << ",\"diff_rate\":" << diffRate
+              << ",\"diffs\":" << numDiffs << ",\"rounds\":" << rounds << ",\"bytes\":" << bytes
+              << ",\"cpu_ms\":" << (1000.0 * (cpuEnd - cpuStart) / CLOCKS_PER_SEC)
+              << ",\"wall_ms\":" << std::chrono::duration<double, std::milli>(wallEnd - wallStart).count() << "}" << std::endl;
+}
+
+
+
+int main() {
+    std::vector<size_t> sizes;
+
+    {
+        std::istringstream ss(getEnv("BENCH_SIZES", "1000000,10000000"));
+        std::string s;
+        while (std::getline(ss, s, ',')) sizes.push_back(std::stoull(s));
+    }
+
+    size_t reconcileSize = std::stoull(getEnv("BENCH_RECONCILE_SIZE", "1000000"));
+    uint64_t frameSizeLimit = std::stoull(getEnv("BENCH_FRAMESIZELIMIT", "0"));
+
+    benchAccumulator();
+
+    for (auto size : sizes) benchVectorSeal(size);
+
+    for (auto size : sizes) benchBTreeMem(size);
+
+    if (enabled("btreelmdb")) {
+        std::string dir = getEnv("BENCH_LMDB_DIR", "testdb-bench/");
+        system((std::string("mkdir -p ") + dir).c_str());
+        system((std::string("rm -f ") + dir + "/*").c_str());
+
+        auto env = lmdb::env::create();
+        env.set_max_dbs(64);
+        env.set_mapsize(1ULL << 40);
+        env.open(dir.c_str(), ::getenv("BENCH_LMDB_WRITEMAP") ? MDB_WRITEMAP : 0);
+
+        lmdb::dbi dbi;
+
+        {
+            auto txn = lmdb::txn::begin(env);
+            dbi = negentropy::storage::BTreeLMDB::setupDB(txn, "bench");
+            txn.commit();
+        }
+
+        for (auto size : sizes) benchBTreeLMDB(env, dbi, size);
+    }
+
+    for (double diffRate : { 0.0001, 0.001, 0.01, 0.1 }) benchReconcile(reconcileSize, diffRate, frameSizeLimit);
+
+    if (check == 0) std::cerr << "unexpected check value" << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,222 @@
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <atomic>
+#include <new>
+
+#include <hoytech/error.h>
+
+#include "negentropy.h"
+#include "negentropy/storage/Vector.h"
+#include "negentropy/storage/BTreeMem.h"
+
+
+
+// Runs an initiator and responder in the same process, so that reconciliation itself can be measured
+// without the hex encoding and pipes of fuzz.pl. Data-sets are generated the same way as fuzz.pl,
+// and the same environment variables are used:
+//
+//   SEED, RECS / MIN_RECS / MAX_RECS, P1 / P2 / P3, CLUSTERED, NUM_SEGS, RECS_PER_SEG,
+//   FRAMESIZELIMIT (or FRAMESIZELIMIT1 / FRAMESIZELIMIT2 for each side)
+//
+// STORAGE selects vector (default) or btreemem. One JSON object is printed per round, followed by a summary.
+
+
+std::atomic<uint64_t> numAllocs = 0;
+std::atomic<uint64_t> numAllocBytes = 0;
+
+void *operator new(size_t size) {
+    numAllocs++;
+    numAllocBytes += size;
+    if (void *p = malloc(size == 0 ? 1 : size)) return p;
+    throw std::bad_alloc();
+}
+
+// GCC can't tell that these pair with the operator new above
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+
+void operator delete(void *p) noexcept {
+    free(p);
+}
+
+void operator delete(void *p, size_t) noexcept {
+    free(p);
+}
+
+#pragma GCC diagnostic pop
+
+
+std::mt19937_64 rng;
+
+uint64_t rnd(uint64_t n) {
+    return n == 0 ? 0 : rng() % n;
+}
+
+std::string randomId() {
+    std::string id(negentropy::ID_SIZE, '\0');
+    for (size_t i = 0; i < negentropy::ID_SIZE; i += 8) {
+        uint64_t r = rng();
+        memcpy(id.data() + i, &r, 8);
+    }
+    return id;
+}
+
+uint64_t getEnvInt(const char *name, uint64_t def) {
+    auto *v = ::getenv(name);
+    return v ? std::stoull(v) : def;
+}
+
+double getEnvDouble(const char *name, double def) {
+    auto *v = ::getenv(name);
+    return v ? std::stod(v) : def;
+}
+
+
+struct Stats {
+    uint64_t nanos = 0;
+    uint64_t allocs = 0;
+    uint64_t allocBytes = 0;
+};
+
+template<typename F>
+auto measure(Stats &stats, F f) {
+    uint64_t allocsBefore = numAllocs, allocBytesBefore = numAllocBytes;
+    auto start = std::chrono::steady_clock::now();
+
+    auto res = f();
+
+    auto end = std::chrono::steady_clock::now();
+    stats.nanos += std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
+    stats.allocs += numAllocs - allocsBefore;
+    stats.allocBytes += numAllocBytes - allocBytesBefore;
+
+    return res;
+}
+
+
+template<typename T>
+void run() {
+    T storage1, storage2;
+    uint64_t expectedHaves = 0, expectedNeeds = 0;
+
+    {
+        double prob1 = getEnvDouble("P1", 1);
+        double prob2 = getEnvDouble("P2", 1);
+        double prob3 = getEnvDouble("P3", 98);
+        double total = prob1 + prob2 + prob3;
+        if (total == 0) throw hoytech::error("zero prob");
+        prob1 /= total;
+        prob2 /= total;
+
+        std::uniform_real_distribution<double> dist(0.0, 1.0);
+
+        auto add = [&](uint64_t created, double modeRnd) {
+            auto id = randomId();
+
+            if (modeRnd < prob1) {
+                storage1.insert(created, id);
+                expectedHaves++;
+            } else if (modeRnd < prob1 + prob2) {
+                storage2.insert(created, id);
+                expectedNeeds++;
+            } else {
+                storage1.insert(created, id);
+                storage2.insert(created, id);
+            }
+        };
+
+        if (::getenv("CLUSTERED")) {
+            uint64_t segments = rnd(getEnvInt("NUM_SEGS", 50'000));
+            uint64_t recsPerSeg = getEnvInt("RECS_PER_SEG", 50);
+            uint64_t curr = 0;
+
+            for (uint64_t i = 0; i < segments; i++) {
+                uint64_t num = rnd(recsPerSeg) + 1;
+                double modeRnd = dist(rng);
+                for (uint64_t j = 0; j < num; j++) add(1677970534 + curr++, modeRnd);
+            }
+        } else {
+            uint64_t minRecs = getEnvInt("MIN_RECS", 1);
+            uint64_t maxRecs = getEnvInt("MAX_RECS", 10'000);
+            if (::getenv("RECS")) minRecs = maxRecs = getEnvInt("RECS", 0);
+            if (minRecs > maxRecs) throw hoytech::error("MIN_RECS > MAX_RECS");
+
+            uint64_t num = minRecs + rnd(maxRecs - minRecs);
+            for (uint64_t i = 0; i < num; i++) add(1677970534 + rnd(num), dist(rng));
+        }
+    }
+
+    storage1.seal();
+    storage2.seal();
+
+    uint64_t frameSizeLimit1 = getEnvInt("FRAMESIZELIMIT1", getEnvInt("FRAMESIZELIMIT", 0));
+    uint64_t frameSizeLimit2 = getEnvInt("FRAMESIZELIMIT2", getEnvInt("FRAMESIZELIMIT", 0));
+
+    Negentropy ne1(storage1, frameSizeLimit1);
+    Negentropy ne2(storage2, frameSizeLimit2);
+
+    Stats totalClient, totalServer;
+    uint64_t totalUp = 0, totalDown = 0, numHaves = 0, numNeeds = 0, round = 0;
+
+    Stats client;
+    std::optional<std::string> msg = measure(client, [&]{ return ne1.initiate(); });
+
+    while (msg) {
+        Stats server;
+        auto response = measure(server, [&]{ return ne2.reconcile(*msg); });
+
+        uint64_t up = msg->size(), down = response.size();
+
+        std::cout << "{\"round\":" << round << ",\"up_bytes\":" << up << ",\"down_bytes\":" << down
+                  << ",\"client_us\":" << client.nanos / 1000.0 << ",\"server_us\":" << server.nanos / 1000.0
+                  << ",\"client_allocs\":" << client.allocs << ",\"server_allocs\":" << server.allocs
+                  << ",\"client_alloc_bytes\":" << client.allocBytes << ",\"server_alloc_bytes\":" << server.allocBytes << "}" << std::endl;
+
+        totalUp += up;
+        totalDown += down;
+        totalClient.nanos += client.nanos;
+        totalClient.allocs += client.allocs;
+        totalClient.allocBytes += client.allocBytes;
+        totalServer.nanos += server.nanos;
+        totalServer.allocs += server.allocs;
+        totalServer.allocBytes += server.allocBytes;
+        round++;
+
+        // Time spent processing a response is attributed to the next round's client time
+
+        client = Stats{};
+        msg = measure(client, [&]{
+            return ne1.reconcile(response, [&](const negentropy::Item &){ numHaves++; }, [&](std::string_view){ numNeeds++; });
+        });
+    }
+
+    totalClient.nanos += client.nanos;
+    totalClient.allocs += client.allocs;
+    totalClient.allocBytes += client.allocBytes;
+
+    if (numHaves != expectedHaves || numNeeds != expectedNeeds) {
+        throw hoytech::error("unexpected have/need counts: ", numHaves, "/", numNeeds, " expected ", expectedHaves, "/", expectedNeeds);
+    }
+
+    std::cout << "{\"summary\":true,\"items1\":" << storage1.size() << ",\"items2\":" << storage2.size()
+              << ",\"rounds\":" << round << ",\"haves\":" << numHaves << ",\"needs\":" << numNeeds
+              << ",\"up_bytes\":" << totalUp << ",\"down_bytes\":" << totalDown
+              << ",\"client_ms\":" << totalClient.nanos / 1e6 << ",\"server_ms\":" << totalServer.nanos / 1e6
+              << ",\"client_allocs\":" << totalClient.allocs << ",\"server_allocs\":" << totalServer.allocs
+              << ",\"client_alloc_bytes\":" << totalClient.allocBytes << ",\"server_alloc_bytes\":" << totalServer.allocBytes << "}" << std::endl;
+}
+
+
+
+int main() {
+    rng.seed(getEnvInt("SEED", 0));
+
+    std::string storageType = ::getenv("STORAGE") ? ::getenv("STORAGE") : "vector";
+
+    if (storageType == "vector") run<negentropy::storage::Vector>();
+    else if (storageType == "btreemem") run<negentropy::storage::BTreeMem>();
+    else throw hoytech::error("unknown STORAGE: ", storageType);
+
+    return 0;
+}
@@ -0,0 +1,194 @@
+#include <iostream>
+#include <set>
+#include <thread>
+
+#include <openssl/sha.h>
+
+#include <hoytech/error.h>
+#include <hoytech/hex.h>
+
+#include "negentropy.h"
+#include "negentropy/storage/Vector.h"
+#include "negentropy/SessionManager.h"
+
+
+
+std::string sha256(std::string_view input) {
+    unsigned char hash[SHA256_DIGEST_LENGTH];
+    SHA256(reinterpret_cast<const unsigned char*>(input.data()), input.size(), hash);
+    return std::string((const char*)&hash[0], SHA256_DIGEST_LENGTH);
+}
+
+std::string uintToId(uint64_t id) {
+    return sha256(std::string((char*)&id, 8));
+}
+
+
+struct CountingVector : negentropy::storage::Vector {
+    std::atomic<uint64_t> numFingerprints = 0;
+
+    negentropy::Fingerprint fingerprint(size_t begin, size_t end) {
+        numFingerprints++;
+        return Vector::fingerprint(begin, end);
+    }
+
+    std::vector<negentropy::Bucket> fingerprintBuckets(size_t begin, size_t end, size_t numBuckets) {
+        numFingerprints += numBuckets;
+        return Vector::fingerprintBuckets(begin, end, numBuckets);
+    }
+};
+
+
+// Syncs a client that is missing every 1000th item, returning the number of needs found
+
+size_t syncClient(negentropy::SessionManager<CountingVector> &manager, const std::string &sessionId, size_t numItems) {
+    negentropy::storage::Vector clientStorage;
+
+    for (size_t i = 0; i < numItems; i++) {
+        if (i % 1000 == 0) continue;
+        clientStorage.insert(100 + i, uintToId(i));
+    }
+
+    clientStorage.seal();
+
+    auto ne = Negentropy(clientStorage, 50'000);
+    std::string msg = ne.initiate();
+    bool first = true;
+    size_t numNeeds = 0;
+
+    while (true) {
+        msg = first ? manager.open(sessionId, msg) : manager.reconcile(sessionId, msg);
+        first = false;
+
+        auto newMsg = ne.reconcile(msg, [&](const negentropy::Item &){
+            throw hoytech::error("unexpected have");
+        }, [&](std::string_view){
+            numNeeds++;
+        });
+
+        if (!newMsg) break;
+        else std::swap(msg, *newMsg);
+    }
+
+    manager.close(sessionId);
+
+    return numNeeds;
+}
+
+
+void testSharedCache() {
+    CountingVector storage;
+
+    for (size_t i = 0; i < 100'000; i++) {
+        storage.insert(100 + i, uintToId(i));
+    }
+
+    storage.seal();
+
+    negentropy::SessionManager manager(storage);
+
+    if (syncClient(manager, "a", 100'000) != 100) throw hoytech::error("wrong number of needs");
+    auto firstCost = storage.numFingerprints.load();
+
+    storage.numFingerprints = 0;
+    if (syncClient(manager, "b", 100'000) != 100) throw hoytech::error("wrong number of needs");
+    if (storage.numFingerprints != 0) throw hoytech::error("identical sync was not served from cache");
+
+    manager.clearCache();
+    storage.numFingerprints = 0;
+    if (syncClient(manager, "c", 100'000) != 100) throw hoytech::error("wrong number of needs");
+    if (storage.numFingerprints != firstCost) throw hoytech::error("clearCache didn't clear");
+
+    // Concurrent sessions
+
+    std::vector<std::thread> threads;
+    std::atomic<size_t> totalNeeds = 0;
+
+    for (size_t i = 0; i < 8; i++) {
+        threads.emplace_back([&, i]{
+            totalNeeds += syncClient(manager, std::string("thread-") + std::to_string(i), 100'000);
+        });
+    }
+
+    for (auto &t : threads) t.join();
+
+    if (totalNeeds != 800) throw hoytech::error("wrong number of needs from concurrent sessions");
+    if (manager.numSessions() != 0) throw hoytech::error("sessions not closed");
+}
+
+
+void testLimits() {
+    CountingVector storage;
+
+    for (size_t i = 0; i < 10'000; i++) {
+        storage.insert(100 + i, uintToId(i));
+    }
+
+    storage.seal();
+
+    negentropy::storage::Vector emptyStorage;
+    emptyStorage.seal();
+
+    auto expectErr = [](auto cb, std::string_view expected) {
+        try {
+            cb();
+        } catch (std::exception &e) {
+            if (std::string_view(e.what()) != expected) throw hoytech::error("unexpected error: ", e.what());
+            return;
+        }
+        throw hoytech::error("expected error: ", expected);
+    };
+
+    {
+        negentropy::SessionManager manager(storage);
+        manager.maxSessions = 2;
+
+        auto query = Negentropy(emptyStorage).initiate();
+
+        manager.open("a", query);
+        manager.open("b", query);
+        manager.open("a", query); // replaces existing session
+
+        expectErr([&]{ manager.open("c", query); }, "too many sessions");
+        expectErr([&]{ manager.reconcile("c", query); }, "unknown session");
+
+        if (manager.numSessions() != 2) throw hoytech::error("wrong number of sessions");
+    }
+
+    {
+        // Client has nothing, so the server responds with all of its IDs, limited by the budget
+
+        negentropy::SessionManager manager(storage);
+        manager.sessionMemoryBudget = 10'000;
+
+        auto query = Negentropy(emptyStorage).initiate();
+        auto resp = manager.open("a", query);
+
+        if (query.size() + resp.size() > manager.sessionMemoryBudget) throw hoytech::error("session memory budget exceeded");
+
+        manager.sessionMemoryBudget = 4096;
+        expectErr([&]{ manager.reconcile("a", query); }, "query exceeds session memory budget");
+    }
+
+    {
+        negentropy::SessionManager manager(storage);
+        manager.cache.maxEntries = 10;
+
+        for (size_t i = 0; i < 3; i++) {
+            storage.numFingerprints = 0;
+            if (syncClient(manager, "a", 10'000) != 10) throw hoytech::error("wrong number of needs");
+            if (storage.numFingerprints == 0) throw hoytech::error("cache maxEntries not respected");
+        }
+    }
+}
+
+
+
+int main() {
+    testSharedCache();
+    testLimits();
+
+    std::cout << "OK" << std::endl;
+
+    return 0;
+}
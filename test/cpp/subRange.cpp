@@ -24,6 +24,32 @@ std::string uintToId(uint64_t id) {
 }
 
 
+void checkBuckets(negentropy::StorageBase &storage) {
+    // Compare the storage's own implementation against the generic one, which computes each bucket separately
+
+    auto check = [&](size_t begin, size_t end, size_t numBuckets) {
+        auto buckets = storage.fingerprintBuckets(begin, end, numBuckets);
+        auto expected = storage.StorageBase::fingerprintBuckets(begin, end, numBuckets);
+
+        if (buckets.size() != expected.size()) throw hoytech::error("fingerprintBuckets size mismatch");
+
+        for (size_t i = 0; i < buckets.size(); i++) {
+            if (buckets[i].fingerprint.sv() != expected[i].fingerprint.sv()) throw hoytech::error("fingerprintBuckets fingerprint mismatch");
+            if (buckets[i].firstItem != expected[i].firstItem) throw hoytech::error("fingerprintBuckets firstItem mismatch");
+            if (buckets[i].lastItem != expected[i].lastItem) throw hoytech::error("fingerprintBuckets lastItem mismatch");
+        }
+    };
+
+    size_t size = storage.size();
+
+    check(0, size, 16);
+    check(0, size, 1);
+    check(size / 3, size, 16);
+    check(0, size / 2, 7);
+    check(size / 2, size / 2 + 5, 16); // some buckets empty
+    check(size, size, 16);
+}
+
 template<typename T>
 void testSubRange() {
     T vecBig;
@@ -61,6 +87,10 @@ void testSubRange() {
         if (lb != lb2) throw hoytech::error("findLowerBound mismatch");
     }
 
+    checkBuckets(vecBig);
+    checkBuckets(vecSmall);
+    checkBuckets(subRange);
+
     {
         auto lb = subRange.findLowerBound(0, subRange.size(), negentropy::Bound(5000));
         auto lb2 = vecSmall.findLowerBound(0, vecSmall.size(), negentropy::Bound(5000));
@@ -122,10 +152,16 @@ void testSync(bool emptySide1, bool emptySide2) {
     auto ne1 = Negentropy(vecSmall, 20'000);
     auto ne2 = Negentropy(subRange, 20'000);
 
+    // Responses computed with multiple threads must be identical
+    auto ne2Parallel = Negentropy(subRange, 20'000);
+    ne2Parallel.reconcileThreads = 4;
+
     std::string msg = ne1.initiate();
 
     while (true) {
+        auto parallelMsg = ne2Parallel.reconcile(msg);
         msg = ne2.reconcile(msg);
+        if (parallelMsg != msg) throw hoytech::error("parallel reconcile mismatch");
 
         std::vector<std::string> have, need;
         auto newMsg = ne1.reconcile(msg, have, need);
@@ -0,0 +1,111 @@
+#include <iostream>
+#include <random>
+
+#include <hoytech/error.h>
+
+#include "negentropy.h"
+#include "negentropy/storage/Vector.h"
+
+
+
+std::mt19937_64 rng(0);
+
+std::vector<negentropy::Item> randomItems(size_t n) {
+    std::vector<negentropy::Item> items(n);
+
+    for (auto &item : items) {
+        item.timestamp = rng() % (n + 1);
+        for (size_t i = 0; i < negentropy::ID_SIZE; i++) item.id[i] = rng() & 0xFF;
+    }
+
+    return items;
+}
+
+
+void testPrefixIndex() {
+    auto items = randomItems(10'000);
+
+    negentropy::storage::Vector ref;
+    for (const auto &item : items) ref.insertItem(item);
+    ref.seal();
+
+    for (size_t stride : { 1, 2, 7, 64, 20'000 }) {
+        negentropy::storage::Vector vec;
+        vec.prefixStride = stride;
+        for (const auto &item : items) vec.insertItem(item);
+        vec.seal();
+
+        if (vec.fingerprint(0, vec.size()).sv() != ref.fingerprint(0, ref.size()).sv()) throw hoytech::error("full fingerprint mismatch, stride ", stride);
+        if (vec.fingerprint(0, 0).sv() != ref.fingerprint(0, 0).sv()) throw hoytech::error("empty fingerprint mismatch, stride ", stride);
+
+        for (size_t iter = 0; iter < 10'000; iter++) {
+            size_t begin = rng() % (items.size() + 1);
+            size_t end = rng() % (items.size() + 1);
+            if (begin > end) std::swap(begin, end);
+
+            if (vec.fingerprint(begin, end).sv() != ref.fingerprint(begin, end).sv()) throw hoytech::error("fingerprint mismatch, stride ", stride, " range ", begin, "-", end);
+        }
+
+        // Changing prefixStride only takes effect at the next seal()
+
+        for (size_t newStride : { size_t(0), stride + 1 }) {
+            vec.prefixStride = newStride;
+            if (vec.fingerprint(1, items.size() - 1).sv() != ref.fingerprint(1, items.size() - 1).sv()) throw hoytech::error("fingerprint mismatch after changing stride to ", newStride, ", stride ", stride);
+        }
+
+        vec.prefixStride = stride;
+
+        vec.unseal();
+        vec.insert(items.size() * 2, std::string(32, '\x01'));
+        vec.seal();
+
+        if (vec.fingerprint(0, vec.size()).sv() == ref.fingerprint(0, ref.size()).sv()) throw hoytech::error("stale prefix index after unseal, stride ", stride);
+        if (vec.fingerprint(0, ref.size()).sv() != ref.fingerprint(0, ref.size()).sv()) throw hoytech::error("prefix fingerprint mismatch after re-seal, stride ", stride);
+    }
+}
+
+void testParallelSeal() {
+    auto items = randomItems(100'000);
+
+    negentropy::storage::Vector ref;
+    for (const auto &item : items) ref.insertItem(item);
+    ref.seal();
+
+    for (size_t numThreads : { 2, 3, 8, 1'000 }) {
+        negentropy::storage::Vector vec;
+        vec.sealThreads = numThreads;
+        for (const auto &item : items) vec.insertItem(item);
+        vec.seal();
+
+        if (vec.items != ref.items) throw hoytech::error("parallel seal ordering mismatch, threads ", numThreads);
+    }
+
+    // Duplicates must be detected regardless of which chunks they are sorted into
+
+    for (size_t dupIndex : { size_t(0), items.size() / 2, items.size() - 1 }) {
+        negentropy::storage::Vector vec;
+        vec.sealThreads = 4;
+        for (const auto &item : items) vec.insertItem(item);
+        vec.insertItem(items[dupIndex]);
+
+        bool threw = false;
+        try {
+            vec.seal();
+        } catch (std::exception &e) {
+            threw = true;
+        }
+
+        if (!threw) throw hoytech::error("parallel seal missed duplicate");
+    }
+}
+
+
+
+int main() {
+    testPrefixIndex();
+    testParallelSeal();
+
+    std::cout << "OK" << std::endl;
+
+    return 0;
+}